@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Extract an ADC capture file from a serial console log.
+
+The input is the serial log of a firmware built with CAPTURE_ENABLED (see
+main/capture.h). Only the CAPTURE lines after the last CAPTURE,BEGIN are used,
+so the whole console log can be passed directly.
+
+    python3 bench/capture.py console.log -o dial.adct
+    ./build-bench/replay_host dial.adct
+
+The records are delta encoded, so every line after a garbled or missing one
+would decode to wrong values. Each line carries its number and a CRC-32; the
+log is rejected if any line fails either check.
+"""
+import argparse
+import sys
+import zlib
+
+
+def parse_line(payload):
+    """Returns (line number, bytes), or None if the line is garbled"""
+    fields = payload.split(",")
+    if len(fields) != 3:
+        return None
+    try:
+        number = int(fields[0])
+        data = bytes.fromhex(fields[1])
+        crc = int(fields[2], 16)
+    except ValueError:
+        return None
+    if zlib.crc32(data) != crc:
+        return None
+    return number, data
+
+
+def extract(lines):
+    data = None
+    expected = 0
+    for line in lines:
+        line = line.strip()
+        marker = line.find("CAPTURE,")
+        if marker < 0:
+            continue
+        payload = line[marker + len("CAPTURE,"):]
+        if payload == "BEGIN":
+            data = bytearray()
+            expected = 0
+        elif payload == "END":
+            break
+        elif data is not None:
+            parsed = parse_line(payload)
+            if parsed is None:
+                sys.exit(f"garbled capture line, the rest of the capture can't be decoded: {line}")
+            number, chunk = parsed
+            if number != expected:
+                sys.exit(f"capture line {expected} is missing, got line {number} instead")
+            data += chunk
+            expected += 1
+    if not data:
+        sys.exit("no capture found in input")
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", type=argparse.FileType("r"), help="serial console log ('-' for stdin)")
+    parser.add_argument("-o", "--output", default="capture.adct",
+                        help="capture file to write (default: %(default)s)")
+    args = parser.parse_args()
+
+    data = extract(args.log)
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print(f"{len(data)} bytes written to {args.output}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
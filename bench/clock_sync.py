@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Time sync client for the potentiometer GATT server.
+
+Keeps one or more devices synced to this computer's clock through the time sync
+service (FFC0, see main/clock_sync.h) and prints their timestamped values (FFC3)
+on that shared timebase, so dial movements of several units line up:
+
+    device,time_us,error_us,value,flags,latency_us
+
+time_us is the capture time on this computer's clock (microseconds since the
+epoch), error_us the bound the device gives for it and latency_us the time from
+capture to the arrival of the notification. Every --status-period seconds each
+device's sync status (FFC2) is printed to stderr.
+
+    pip install bleak
+    python3 bench/clock_sync.py AA:BB:CC:DD:EE:01 AA:BB:CC:DD:EE:02 --duration 600 > aligned.csv
+
+Sync quality follows the connection interval; the host simulation
+(bench/host/sync_host.c) shows what to expect.
+"""
+import argparse
+import asyncio
+import struct
+import sys
+import time
+
+from bleak import BleakClient
+
+SYNC_EXCHANGE_UUID = "0000ffc1-0000-1000-8000-00805f9b34fb"
+SYNC_STATUS_UUID = "0000ffc2-0000-1000-8000-00805f9b34fb"
+TIMESTAMPED_UUID = "0000ffc3-0000-1000-8000-00805f9b34fb"
+
+# Little-endian layouts of the structs in main/clock_sync.h
+REQUEST = struct.Struct("<qq")
+REPLY = struct.Struct("<qII")
+VALUE = struct.Struct("<qIHH")
+STATUS = struct.Struct("<qIiIIIIiIII")
+STATUS_FIELDS = ("time_us", "error_us", "drift_ppb", "exchanges", "rejected", "last_delay_us",
+                 "min_delay_us", "last_error_us", "max_error_us", "rms_error_us", "fitted")
+UNSYNCED = 0xFFFFFFFF
+
+
+def now_us():
+    return time.time_ns() // 1000
+
+
+async def run_device(address, args, deadline):
+    """Sync round trips and value notifications until the deadline."""
+    replies = asyncio.Queue()
+
+    def on_reply(_sender, data):
+        replies.put_nowait((REPLY.unpack(data)[0], now_us()))
+
+    def on_value(_sender, data):
+        arrived = now_us()
+        time_us, error_us, value, flags = VALUE.unpack(data)
+        if error_us != UNSYNCED:
+            print(f"{address},{time_us},{error_us},{value},{flags:#06x},{arrived - time_us}", flush=True)
+
+    async with BleakClient(address, timeout=args.connect_timeout) as client:
+        await client.start_notify(SYNC_EXCHANGE_UUID, on_reply)
+        await client.start_notify(TIMESTAMPED_UUID, on_value)
+        prev_return_us = 0
+        next_status = time.monotonic() + args.status_period
+        while time.monotonic() < deadline:
+            send_us = now_us()
+            await client.write_gatt_char(SYNC_EXCHANGE_UUID, REQUEST.pack(send_us, prev_return_us), response=False)
+            # Only the reply to this request completes the round trip
+            prev_return_us = 0
+            try:
+                while True:
+                    echoed, arrived = await asyncio.wait_for(replies.get(), timeout=args.reply_timeout)
+                    if echoed == send_us:
+                        prev_return_us = arrived
+                        break
+            except asyncio.TimeoutError:
+                pass
+
+            if time.monotonic() >= next_status:
+                status = dict(zip(STATUS_FIELDS, STATUS.unpack(await client.read_gatt_char(SYNC_STATUS_UUID))))
+                print(f"{address}: " + " ".join(f"{k}={v}" for k, v in status.items()), file=sys.stderr)
+                next_status += args.status_period
+            await asyncio.sleep(args.period)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("addresses", nargs="+", help="device addresses")
+    parser.add_argument("--duration", type=float, default=60.0, help="run length in seconds (default: %(default)s)")
+    parser.add_argument("--period", type=float, default=1.0, help="seconds between round trips (default: %(default)s)")
+    parser.add_argument("--reply-timeout", type=float, default=0.5, help="seconds to wait for a reply (default: %(default)s)")
+    parser.add_argument("--status-period", type=float, default=10.0, help="seconds between status reads (default: %(default)s)")
+    parser.add_argument("--connect-timeout", type=float, default=10.0, help="connection timeout in seconds (default: %(default)s)")
+    args = parser.parse_args()
+
+    print("device,time_us,error_us,value,flags,latency_us", flush=True)
+    deadline = time.monotonic() + args.duration
+    await asyncio.gather(*(run_device(address, args, deadline) for address in args.addresses))
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Compare benchmark results against a baseline.
+
+Both files are the CSV printed by the benchmarks (bench/host/bench_host or the
+firmware built with BENCH_ENABLED). Lines starting with '#' are ignored, so a
+serial log trimmed to the benchmark output can be passed directly.
+
+    python3 bench/compare.py bench/baselines/host.csv results.csv
+
+Exits with status 1 if any stage's mean or jitter regressed by more than the
+threshold (default 10%).
+"""
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    with open(path, newline="") as f:
+        rows = csv.DictReader(line for line in f if line.strip() and not line.startswith("#"))
+        return {(r["platform"], r["core"], r["stage"]): r for r in rows}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("results")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed regression in percent (default: %(default)s)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    results = load(args.results)
+    regressed = False
+
+    print(f"{'platform':8} {'core':>4} {'stage':18} {'mean':>14} {'jitter':>14} {'memory':>12}")
+    for key in sorted(results):
+        new = results[key]
+        old = baseline.get(key)
+        if old is None:
+            print(f"{key[0]:8} {key[1]:>4} {key[2]:18} {'(no baseline)':>14}")
+            continue
+        line = f"{key[0]:8} {key[1]:>4} {key[2]:18}"
+        for field, width in (("mean", 14), ("jitter", 14), ("state_bytes", 12)):
+            before, after = int(old[field]), int(new[field])
+            change = (after - before) * 100.0 / before if before else 0.0
+            line += f" {f'{before}->{after}':>{width - 8}} {change:+6.1f}%"
+            if field != "state_bytes" and change > args.threshold and after - before > 1:
+                regressed = True
+        print(line)
+
+    for key in sorted(set(baseline) - set(results)):
+        print(f"{key[0]:8} {key[1]:>4} {key[2]:18} (missing from results)")
+
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,54 @@
+/* Host runner for the portable pipeline stage benchmarks
+
+Runs the same stage workloads as the firmware (main/bench_stages.c) pinned to
+one CPU and prints the results as CSV, timed with the time stamp counter on x86
+and in nanoseconds elsewhere.
+*/
+#define _GNU_SOURCE
+
+/* Standard headers */
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Application module headers */
+#include "bench.h"
+
+#define BENCH_HOST_CPU 0
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_HOST_UNIT "cycles"
+
+static uint32_t bench_host_clock(void)
+{
+    return (uint32_t)__builtin_ia32_rdtsc();
+}
+#else
+#define BENCH_HOST_UNIT "ns"
+
+static uint32_t bench_host_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+#endif
+
+
+int main(void)
+{
+    struct bench_result results[BENCH_MAX_STAGES];
+    cpu_set_t cpus;
+
+    /* Pin to one CPU so migrations don't show up as jitter */
+    CPU_ZERO(&cpus);
+    CPU_SET(BENCH_HOST_CPU, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        fprintf(stderr, "warning: could not pin to cpu %d\n", BENCH_HOST_CPU);
+    }
+
+    int count = bench_run_portable_stages(bench_host_clock, results);
+    bench_print_csv_header();
+    bench_print_csv("host", BENCH_HOST_CPU, BENCH_HOST_UNIT, results, count);
+    return 0;
+}
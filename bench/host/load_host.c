@@ -0,0 +1,429 @@
+/* Host simulation of several centrals subscribed at once (see main/notify.h)
+
+Runs a number of virtual centrals against the firmware's own notification
+schedule (main/notify_schedule.c) and snapshot latch on a simulated clock. Each
+central connects, subscribes to FFF1 and, if sessions are enabled, disconnects
+again after a random time and reconnects later. The notifier makes the same
+passes as the firmware's notify task: it wakes on every published sample and
+whenever a subscription is due, hands each subscription at most
+LOAD_MAX_IN_FLIGHT notifications, and holds back the rest. The link only moves
+notifications at connection events, and every connection gets an equal share of
+the connection interval's air time.
+
+    ./build-bench/load_host [-c centrals] [-i interval_ms] [-e packets_per_event]
+                            [-l loss_pct] [-n notify_ms] [-m min_interval_ms]
+                            [-b deadband] [-p sample_ms] [-S session_s]
+                            [-t duration_s] [-s seed]
+
+Prints one CSV row: connections and notification counters as the device's
+"load:" line reports them, the latency from sample capture to the host accepting
+the notification (what the device measures) and to the central receiving it,
+and the slowest and fastest notification rate seen by a central.
+
+This does not run the NimBLE host or controller; the mbuf pool and GATT
+discovery are not modelled.
+*/
+
+/* Standard headers */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Application module headers */
+#include "ble.h"
+#include "notify_schedule.h"
+#include "snapshot.h"
+
+#define LOAD_MAX_CENTRALS     32
+#define LOAD_MAX_IN_FLIGHT    2       // As NOTIFY_MAX_IN_FLIGHT in notify.h
+#define LOAD_PACKET_US        800     // One notification and its acknowledgement on air
+#define LOAD_SETUP_MS         200     // Connection to subscription: discovery and the CCCD write
+#define LOAD_RECONNECT_MS     1000    // Mean time before a central reconnects
+#define LOAD_STEP_MAX         40      // Largest change of the dial between samples, in ADC codes
+
+struct load_params {
+    uint32_t centrals;
+    double interval_us;       // BLE connection interval
+    uint32_t per_event;       // Most notifications one connection event carries
+    double loss_pct;          // Connection events lost to interference, retried at the next
+    uint32_t notify_period_ms;
+    struct notify_params subscription;  // Parameters every central writes to FFF4
+    double sample_us;         // Between published samples
+    double session_us;        // Mean time a central stays connected, 0 to stay for the whole run
+    double duration_us;
+    uint64_t seed;
+};
+
+struct load_central {
+    bool subscribed;
+    int64_t change_us;        // Next subscription or disconnection
+    int64_t event_us;         // Next connection event
+    int64_t subscribed_us;    // Start of the current subscription
+    struct notify_schedule schedule;
+    uint8_t in_flight;
+    int64_t capture_us[LOAD_MAX_IN_FLIGHT];  // Capture time of each fresh notification in flight, or -1
+    uint32_t received;
+    int64_t connected_total_us;
+};
+
+struct load_result {
+    uint32_t connects;
+    uint32_t sent;
+    uint32_t completed;
+    uint32_t coalesced;
+    uint32_t retries;
+    uint32_t drops;
+    uint32_t max_depth;       // Notifications in flight across all connections
+    uint32_t passes;          // Notify task passes
+    uint32_t accepted;        // Fresh notifications accepted by the host
+    int64_t accept_total_us;
+    int64_t accept_max_us;
+    uint32_t delivered;       // Fresh notifications received by a central
+    int64_t delivery_total_us;
+    int64_t delivery_max_us;
+    double rate_min_hz;
+    double rate_max_hz;
+};
+
+static struct load_central load_centrals[LOAD_MAX_CENTRALS];
+static uint64_t load_rng;
+
+
+/* xorshift64*, uniform in [0, 1) */
+static double uniform(void)
+{
+    load_rng ^= load_rng >> 12;
+    load_rng ^= load_rng << 25;
+    load_rng ^= load_rng >> 27;
+    return (double)((load_rng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+
+static double exponential(double mean)
+{
+    return mean > 0 ? -mean * log(1 - uniform()) : 0;
+}
+
+
+static uint32_t subscribed_count(const struct load_params *params)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < params->centrals; i++) {
+        count += load_centrals[i].subscribed;
+    }
+    return count;
+}
+
+
+/* Notifications a connection event carries while count connections share the air */
+static uint32_t event_capacity(const struct load_params *params, uint32_t count)
+{
+    uint32_t fits = (uint32_t)(params->interval_us / (count > 0 ? count : 1) / LOAD_PACKET_US);
+    if (fits < 1) {
+        fits = 1;
+    }
+    return fits < params->per_event ? fits : params->per_event;
+}
+
+
+static void subscribe(const struct load_params *params, struct load_central *central, int64_t now_us,
+                      struct load_result *result)
+{
+    struct potentiometer_snapshot current;
+
+    snapshot_read(&current);
+    central->subscribed = true;
+    central->subscribed_us = now_us;
+    central->event_us = now_us + (int64_t)(uniform() * params->interval_us);
+    central->in_flight = 0;
+    notify_schedule_start(&central->schedule, &params->subscription, params->notify_period_ms,
+                          current.seq, (uint32_t)(now_us / 1000));
+    central->change_us = params->session_us > 0 ? now_us + (int64_t)exponential(params->session_us)
+                                                : INT64_MAX;
+    result->connects++;
+}
+
+
+static void disconnect(struct load_central *central, int64_t now_us)
+{
+    central->subscribed = false;
+    central->connected_total_us += now_us - central->subscribed_us;
+    central->change_us = now_us + (int64_t)(exponential(LOAD_RECONNECT_MS * 1000.0) + LOAD_SETUP_MS * 1000);
+}
+
+
+/* One connection event: completes the oldest notifications in flight */
+static void connection_event(const struct load_params *params, struct load_central *central, int64_t now_us,
+                             struct load_result *result)
+{
+    uint32_t capacity = event_capacity(params, subscribed_count(params));
+
+    central->event_us = now_us + (int64_t)params->interval_us;
+    if (central->in_flight == 0 || uniform() * 100 < params->loss_pct) {
+        return;
+    }
+    while (capacity-- > 0 && central->in_flight > 0) {
+        int64_t capture_us = central->capture_us[0];
+        if (capture_us >= 0) {
+            int64_t latency_us = now_us - capture_us;
+            result->delivered++;
+            result->delivery_total_us += latency_us;
+            if (latency_us > result->delivery_max_us) {
+                result->delivery_max_us = latency_us;
+            }
+        }
+        for (int i = 1; i < central->in_flight; i++) {
+            central->capture_us[i - 1] = central->capture_us[i];
+        }
+        central->in_flight--;
+        central->received++;
+        result->completed++;
+    }
+}
+
+
+/* One pass of the notify task over every subscription (see notify_service).
+ * Returns the time until it needs to run again, in ms */
+static uint32_t notify_pass(const struct load_params *params, int64_t now_us, struct load_result *result)
+{
+    uint32_t now_ms = (uint32_t)(now_us / 1000);
+    uint32_t wait = params->notify_period_ms;
+    uint32_t depth = 0;
+    struct potentiometer_snapshot current;
+
+    snapshot_read(&current);
+    result->passes++;
+    for (uint32_t i = 0; i < params->centrals; i++) {
+        struct load_central *central = &load_centrals[i];
+        if (!central->subscribed) {
+            continue;
+        }
+        if (notify_schedule_update(&central->schedule, &current, now_ms)) {
+            result->coalesced++;
+        }
+        if (central->schedule.pending) {
+            if (central->in_flight < LOAD_MAX_IN_FLIGHT) {
+                bool fresh = notify_schedule_sent(&central->schedule, &current, now_ms);
+                central->capture_us[central->in_flight++] = fresh ? current.timestamp_us : -1;
+                result->sent++;
+                if (fresh) {
+                    int64_t latency_us = now_us - current.timestamp_us;
+                    result->accepted++;
+                    result->accept_total_us += latency_us;
+                    if (latency_us > result->accept_max_us) {
+                        result->accept_max_us = latency_us;
+                    }
+                }
+            } else {
+                bool backed_off;
+                result->retries++;
+                if (notify_schedule_hold_back(&central->schedule, &backed_off)) {
+                    result->drops++;
+                    notify_schedule_drop(&central->schedule);
+                }
+            }
+        }
+        depth += central->in_flight;
+        uint32_t due = notify_schedule_wait_ms(&central->schedule, now_ms, params->notify_period_ms);
+        if (due < wait) {
+            wait = due;
+        }
+    }
+    if (depth > result->max_depth) {
+        result->max_depth = depth;
+    }
+    return wait;
+}
+
+
+/* Events at the same time run in this order */
+enum load_event {
+    LOAD_SAMPLE,
+    LOAD_CHANGE,
+    LOAD_LINK,
+    LOAD_NOTIFY,
+};
+
+static void simulate(const struct load_params *params, struct load_result *result)
+{
+    struct potentiometer_sample sample = {.value = 2048};
+    int64_t sample_us = 0;
+    int64_t notify_us = 0;
+    int64_t end_us = (int64_t)params->duration_us;
+
+    *result = (struct load_result){0};
+    load_rng = params->seed ? params->seed : 1;
+    for (uint32_t i = 0; i < params->centrals; i++) {
+        load_centrals[i] = (struct load_central){
+            .change_us = (int64_t)(uniform() * LOAD_RECONNECT_MS * 1000) + LOAD_SETUP_MS * 1000,
+            .event_us = INT64_MAX,
+        };
+    }
+
+    while (true) {
+        enum load_event event = LOAD_SAMPLE;
+        struct load_central *central = NULL;
+        int64_t now_us = sample_us;
+        for (uint32_t i = 0; i < params->centrals; i++) {
+            struct load_central *candidate = &load_centrals[i];
+            if (candidate->change_us < now_us) {
+                event = LOAD_CHANGE;
+                now_us = candidate->change_us;
+                central = candidate;
+            }
+            if (candidate->subscribed && candidate->event_us < now_us) {
+                event = LOAD_LINK;
+                now_us = candidate->event_us;
+                central = candidate;
+            }
+        }
+        if (notify_us < now_us) {
+            event = LOAD_NOTIFY;
+            now_us = notify_us;
+        }
+        if (now_us > end_us) {
+            break;
+        }
+
+        switch (event) {
+        case LOAD_SAMPLE: {
+            /* The dial wanders; publishing wakes the notify task */
+            int step = (int)(uniform() * (2 * LOAD_STEP_MAX + 1)) - LOAD_STEP_MAX;
+            int value = sample.value + step;
+            sample.value = (uint16_t)(value < 0 ? 0 : value > 4095 ? 4095 : value);
+            sample.timestamp_us = now_us;
+            snapshot_publish(&sample);
+            sample_us = now_us + (int64_t)params->sample_us;
+            notify_us = now_us;
+            break;
+        }
+
+        case LOAD_CHANGE:
+            if (central->subscribed) {
+                disconnect(central, now_us);
+            } else {
+                subscribe(params, central, now_us, result);
+                notify_us = now_us;
+            }
+            break;
+
+        case LOAD_LINK:
+            connection_event(params, central, now_us, result);
+            break;
+
+        case LOAD_NOTIFY: {
+            uint32_t wait_ms = notify_pass(params, now_us, result);
+            notify_us = now_us + 1000 * (int64_t)(wait_ms > 0 ? wait_ms : 1);
+            break;
+        }
+        }
+    }
+
+    result->rate_min_hz = INFINITY;
+    for (uint32_t i = 0; i < params->centrals; i++) {
+        struct load_central *central = &load_centrals[i];
+        if (central->subscribed) {
+            central->connected_total_us += end_us - central->subscribed_us;
+        }
+        double rate_hz = central->connected_total_us > 0 ? central->received * 1e6 / central->connected_total_us : 0;
+        if (rate_hz < result->rate_min_hz) {
+            result->rate_min_hz = rate_hz;
+        }
+        if (rate_hz > result->rate_max_hz) {
+            result->rate_max_hz = rate_hz;
+        }
+    }
+}
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-c centrals] [-i interval_ms] [-e packets_per_event] [-l loss_pct] "
+                    "[-n notify_ms] [-m min_interval_ms] [-b deadband] [-p sample_ms] [-S session_s] "
+                    "[-t duration_s] [-s seed]\n", program);
+    exit(2);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct load_params params = {
+        .centrals = 4,
+        .interval_us = 30000,
+        .per_event = 4,
+        .loss_pct = 2,
+        .notify_period_ms = BLE_NOTIFICATION_PERIOD_MS,
+        .sample_us = 50000,
+        .session_us = 0,
+        .duration_us = 120e6,
+        .seed = 1,
+    };
+    int option;
+
+    while ((option = getopt(argc, argv, "c:i:e:l:n:m:b:p:S:t:s:")) != -1) {
+        switch (option) {
+        case 'c':
+            params.centrals = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            params.interval_us = strtod(optarg, NULL) * 1000;
+            break;
+        case 'e':
+            params.per_event = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            params.loss_pct = strtod(optarg, NULL);
+            break;
+        case 'n':
+            params.notify_period_ms = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            params.subscription.min_interval_ms = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            params.subscription.deadband = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            params.sample_us = strtod(optarg, NULL) * 1000;
+            break;
+        case 'S':
+            params.session_us = strtod(optarg, NULL) * 1e6;
+            break;
+        case 't':
+            params.duration_us = strtod(optarg, NULL) * 1e6;
+            break;
+        case 's':
+            params.seed = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || params.centrals == 0 || params.centrals > LOAD_MAX_CENTRALS ||
+        params.interval_us <= 0 || params.per_event == 0 || params.loss_pct < 0 || params.loss_pct >= 100 ||
+        params.notify_period_ms == 0 || params.sample_us <= 0 || params.session_us < 0 ||
+        params.duration_us <= 0 || !notify_params_valid(&params.subscription)) {
+        usage(argv[0]);
+    }
+
+    struct load_result result;
+    simulate(&params, &result);
+
+    printf("centrals,interval_ms,per_event,loss_pct,notify_ms,min_interval_ms,deadband,sample_ms,session_s,"
+           "duration_s,connects,sent,completed,coalesced,retries,drops,max_depth,passes,accept_mean_us,"
+           "accept_max_us,delivery_mean_us,delivery_max_us,rate_min_hz,rate_max_hz\n");
+    printf("%" PRIu32 ",%.1f,%" PRIu32 ",%.1f,%" PRIu32 ",%u,%u,%.0f,%.0f,%.0f,%" PRIu32 ",%" PRIu32 ",%" PRIu32
+           ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%lld,%lld,%lld,%lld,%.2f,%.2f\n",
+           params.centrals, params.interval_us / 1000, params.per_event, params.loss_pct,
+           params.notify_period_ms, params.subscription.min_interval_ms, params.subscription.deadband,
+           params.sample_us / 1000, params.session_us / 1e6, params.duration_us / 1e6,
+           result.connects, result.sent, result.completed, result.coalesced, result.retries, result.drops,
+           result.max_depth, result.passes,
+           (long long)(result.accepted ? result.accept_total_us / result.accepted : 0),
+           (long long)result.accept_max_us,
+           (long long)(result.delivered ? result.delivery_total_us / result.delivered : 0),
+           (long long)result.delivery_max_us, result.rate_min_hz, result.rate_max_hz);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/* Host check of the ADC calibration table (see main/adc_lut.h)
+
+Builds tables from a set of calibration curves and checks every ADC code against
+a reference computed in floating point:
+- reference: a smooth ESP32-like curve at 12 dB attenuation, millivolts within
+  LUT_MV_TOLERANCE and position within LUT_PERCENT_TOLERANCE of the reference,
+  0 at the first code and ADC_LUT_PERCENT_SCALE at the last (and beyond)
+- dips: a curve that runs backwards in places, held at the highest value so far
+- saturate: a curve that leaves the uint16_t range at both ends, clamped to 0
+  and UINT16_MAX
+- flat: a constant curve, where the position has no range and stays at 0
+
+    ./build-bench/lut_host
+
+Prints one CSV row per curve with the largest errors found. Exits with status 1
+if any code failed a check.
+*/
+
+/* Standard headers */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Application module headers */
+#include "adc_lut.h"
+
+#define LUT_MV_TOLERANCE       0.5  // Rounding of the curve to whole millivolts
+#define LUT_PERCENT_TOLERANCE  1.0  // Truncation to hundredths of a percent
+
+/* One curve and what the table built from it must look like */
+struct lut_case {
+    const char *name;
+    double (*reference)(int raw);  // Millivolts, before the table clamps them
+};
+
+struct lut_result {
+    uint32_t failures;
+    double mv_error;       // Largest |table - expected| in millivolts
+    double percent_error;  // Largest |position - expected| in hundredths of a percent
+};
+
+static struct adc_lut lut_table;
+
+
+/* Roughly an ESP32 at 12 dB attenuation: linear over most of the range and
+ * compressed towards the top */
+static double reference_curve(int raw)
+{
+    double linear = 142 + raw * 3034.0 / (ADC_LUT_SIZE - 1);
+    double knee = raw > 3000 ? (raw - 3000) * (raw - 3000) / 6000.0 : 0;
+    return linear - knee;
+}
+
+
+/* Runs backwards for a stretch every 512 codes */
+static double dipping_curve(int raw)
+{
+    return 100 + raw - ((raw % 512 >= 256) ? (raw % 512 - 256) * 1.5 : 0);
+}
+
+
+/* Starts below zero and ends above UINT16_MAX */
+static double saturating_curve(int raw)
+{
+    return -5000 + raw * 20.0;
+}
+
+
+static double flat_curve(int raw)
+{
+    (void)raw;
+    return 1100;
+}
+
+
+static int curve_adapter(int raw, void *context)
+{
+    const struct lut_case *lut_case = context;
+    return (int)lround(lut_case->reference(raw));
+}
+
+
+/* What each entry must approximate: the curve clamped to the uint16_t range and
+ * to the highest value before it */
+static void expected_table(const struct lut_case *lut_case, double *expected)
+{
+    double highest = 0;
+    for (int raw = 0; raw < ADC_LUT_SIZE; raw++) {
+        double mv = lut_case->reference(raw);
+        if (mv < highest) {
+            mv = highest;
+        }
+        if (mv > UINT16_MAX) {
+            mv = UINT16_MAX;
+        }
+        expected[raw] = mv;
+        highest = mv;
+    }
+}
+
+
+static void check(struct lut_result *result, bool ok, const char *name, int raw, const char *what)
+{
+    if (!ok) {
+        if (result->failures++ == 0) {
+            fprintf(stderr, "%s: code %d: %s\n", name, raw, what);
+        }
+    }
+}
+
+
+static void run_case(const struct lut_case *lut_case, struct lut_result *result)
+{
+    static double expected[ADC_LUT_SIZE];
+    double lowest;
+    double range;
+
+    *result = (struct lut_result){0};
+    adc_lut_build(&lut_table, curve_adapter, (void *)lut_case);
+    expected_table(lut_case, expected);
+    /* The position is linear in the table's whole millivolts */
+    lowest = round(expected[0]);
+    range = round(expected[ADC_LUT_SIZE - 1]) - lowest;
+
+    for (int raw = 0; raw < ADC_LUT_SIZE; raw++) {
+        uint16_t mv = adc_lut_millivolts(&lut_table, raw);
+        uint16_t percent = adc_lut_percent(&lut_table, raw);
+        double mv_error = fabs(mv - expected[raw]);
+        double percent_expected = range > 0 ? (round(expected[raw]) - lowest) * ADC_LUT_PERCENT_SCALE / range
+                                            : 0;
+        double percent_error = fabs(percent - percent_expected);
+
+        if (mv_error > result->mv_error) {
+            result->mv_error = mv_error;
+        }
+        if (percent_error > result->percent_error) {
+            result->percent_error = percent_error;
+        }
+        check(result, mv_error <= LUT_MV_TOLERANCE, lut_case->name, raw, "millivolts off the curve");
+        check(result, percent_error <= LUT_PERCENT_TOLERANCE, lut_case->name, raw, "position off the curve");
+        check(result, raw == 0 || mv >= adc_lut_millivolts(&lut_table, raw - 1), lut_case->name, raw,
+              "table runs backwards");
+        check(result, percent <= ADC_LUT_PERCENT_SCALE, lut_case->name, raw, "position out of range");
+    }
+
+    /* Endpoints, and codes beyond the table */
+    check(result, adc_lut_percent(&lut_table, 0) == 0, lut_case->name, 0, "position not 0 at the first code");
+    check(result, range == 0 || adc_lut_percent(&lut_table, ADC_LUT_SIZE - 1) == ADC_LUT_PERCENT_SCALE,
+          lut_case->name, ADC_LUT_SIZE - 1, "position not full scale at the last code");
+    check(result, adc_lut_millivolts(&lut_table, ADC_LUT_SIZE) == adc_lut_millivolts(&lut_table, ADC_LUT_SIZE - 1) &&
+          adc_lut_percent(&lut_table, UINT32_MAX) == adc_lut_percent(&lut_table, ADC_LUT_SIZE - 1),
+          lut_case->name, ADC_LUT_SIZE, "code beyond the table not clamped");
+}
+
+
+int main(void)
+{
+    static const struct lut_case cases[] = {
+        {"reference", reference_curve},
+        {"dips", dipping_curve},
+        {"saturate", saturating_curve},
+        {"flat", flat_curve},
+    };
+    uint32_t failures = 0;
+
+    printf("curve,codes,first_mv,last_mv,mv_error_max,percent_error_max,failures\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        struct lut_result result;
+        run_case(&cases[i], &result);
+        printf("%s,%d,%u,%u,%.2f,%.2f,%" PRIu32 "\n", cases[i].name, ADC_LUT_SIZE,
+               adc_lut_millivolts(&lut_table, 0), adc_lut_millivolts(&lut_table, ADC_LUT_SIZE - 1),
+               result.mv_error, result.percent_error, result.failures);
+        failures += result.failures;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,482 @@
+/* Host replay of recorded ADC captures (see main/capture.h)
+
+Feeds the samples of one or more capture files through the pipeline and the
+notification logic on a simulated clock, so a recorded dial movement runs
+deterministically and much faster than real time. The stage graph
+(pipeline_graph.c), the change filter, the snapshot latch, the notification
+schedule of one subscription (notify_schedule.c) and the payload encoding are
+the firmware's own code. The replay stands in for the ULP (each record is what
+one poll of the ULP source returned), the FreeRTOS queues and tasks, and the
+link, which is assumed to keep up.
+
+    ./build-bench/replay_host [-t tolerance] [-d dequeue_ms] [-B batch_ms] [-n notify_ms]
+                              [-m heartbeat_ms] [-b deadband] capture.adct...
+
+Prints one CSV row per capture. Everything but the cpu columns depends only on
+the capture and the parameters, so two builds or two settings can be compared on
+the same recorded workload.
+*/
+
+/* Standard headers */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Application module headers */
+#include "ble.h"
+#include "capture_file.h"
+#include "consumer.h"
+#include "filter.h"
+#include "notify_schedule.h"
+#include "pipeline.h"
+#include "producer.h"
+#include "snapshot.h"
+
+/* Pipeline parameters, defaulting to the runtime configuration defaults */
+struct replay_params {
+    uint32_t adc_change_tol;
+    uint32_t dequeue_wait_ms;
+    uint32_t notify_period_ms;
+    uint32_t batch_ms;                  // Source batching deadline, see pipeline_graph.h
+    struct notify_params subscription;  // Parameters the subscriber writes to FFF4
+};
+
+/* Output of one replay */
+struct replay_result {
+    uint32_t samples;         // Samples in the capture
+    int64_t duration_us;      // First to last sample
+    uint32_t changes;         // Samples passing the change filter
+    uint32_t queue_full;      // Changes lost because the GATT sink's queue was full
+    uint32_t published;       // Snapshots published by the GATT sink
+    uint32_t notifications;   // Notifications sent
+    uint32_t fresh;           // Notifications carrying a snapshot not sent before
+    int64_t latency_total_us; // Capture to first notification, over fresh notifications
+    int64_t latency_max_us;
+    uint64_t cpu_ns;          // Host time spent replaying
+};
+
+/* State of the change filter stage */
+struct replay_change {
+    uint32_t tolerance;
+    uint32_t previous;  // Last value let through
+};
+
+/* Input queue of a queued stage */
+struct replay_queue {
+    struct pipeline_batch *batches[PIPELINE_MAX_QUEUE_LEN];
+    unsigned head;
+    unsigned count;
+};
+
+/* Simulated clock and the tasks' next wake ups */
+struct replay_sim {
+    int64_t now_us;
+    int64_t sink_us;    // Next pass of the GATT sink's task, INT64_MAX while it waits for its queue
+    int64_t notify_us;  // Next pass of the notify task
+    const struct capture_record *record;  // What the next poll of the ULP source returns
+    /* Batch pool */
+    struct pipeline_batch pool[PIPELINE_POOL_LEN];
+    struct pipeline_batch *free[PIPELINE_POOL_LEN];
+    int free_count;
+};
+
+static struct replay_sim replay_sim;
+
+
+/* Platform hooks of the pipeline graph */
+struct pipeline_batch *pipeline_port_acquire(void)
+{
+    return (replay_sim.free_count > 0) ? replay_sim.free[--replay_sim.free_count] : NULL;
+}
+
+
+void pipeline_port_release(struct pipeline_batch *batch)
+{
+    replay_sim.free[replay_sim.free_count++] = batch;
+}
+
+
+bool pipeline_port_send(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    struct replay_queue *queue = stage->input;
+    if (queue->count == stage->queue_len) {
+        return false;
+    }
+    queue->batches[(queue->head + queue->count++) % stage->queue_len] = batch;
+    /* The only queued stage is the GATT sink; waiting on its queue, it wakes straight away */
+    if (replay_sim.sink_us == INT64_MAX) {
+        replay_sim.sink_us = replay_sim.now_us;
+    }
+    return true;
+}
+
+
+struct pipeline_batch *pipeline_port_receive(struct pipeline_stage *stage)
+{
+    struct replay_queue *queue = stage->input;
+    if (queue->count == 0) {
+        return NULL;
+    }
+    struct pipeline_batch *batch = queue->batches[queue->head];
+    queue->head = (queue->head + 1) % stage->queue_len;
+    queue->count--;
+    return batch;
+}
+
+
+/* The replay is timed as a whole */
+uint32_t pipeline_port_cycles(void)
+{
+    return 0;
+}
+
+
+uint32_t pipeline_port_ms(void)
+{
+    return (uint32_t)(replay_sim.now_us / 1000);
+}
+
+
+/* Everything runs on one thread */
+void pipeline_port_lock(void)
+{
+}
+
+
+void pipeline_port_unlock(void)
+{
+}
+
+
+/* Stages standing in for the firmware's (see producer.c and consumer.c) */
+static bool ulp_source_poll(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    (void)stage;
+    batch->samples[batch->count++] = (struct potentiometer_sample){
+        .timestamp_us = replay_sim.record->timestamp_us,
+        .value = replay_sim.record->value,
+    };
+    return true;
+}
+
+
+static void change_filter_process(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    struct replay_change *filter = stage->ctx;
+    batch->count = adc_change_filter(batch->samples, batch->count, &filter->previous, filter->tolerance);
+}
+
+
+static void gatt_sink_process(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    (void)stage;
+    for (int i = 0; i < batch->count; i++) {
+        snapshot_publish(&batch->samples[i]);
+    }
+    /* Publishing wakes the notify task */
+    replay_sim.notify_us = replay_sim.now_us;
+}
+
+
+static uint32_t gatt_sink_period_ms(struct pipeline_stage *stage)
+{
+    const struct replay_params *params = stage->ctx;
+    return params->dequeue_wait_ms;
+}
+
+
+static uint64_t host_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    uint8_t *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t got;
+    do {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            uint8_t *grown = realloc(data, capacity);
+            if (grown == NULL) {
+                free(data);
+                fclose(file);
+                return NULL;
+            }
+            data = grown;
+        }
+        got = fread(data + size, 1, capacity - size, file);
+        size += got;
+    } while (got > 0);
+    fclose(file);
+    *len = size;
+    return data;
+}
+
+
+/* Decode a capture file. Returns the number of records, or -1 if it isn't one */
+static long decode_capture(const uint8_t *data, size_t len, struct capture_record **records)
+{
+    struct capture_codec codec;
+    size_t offset = CAPTURE_HEADER_LEN;
+    long count = 0;
+
+    if (!capture_decode_header(data, len)) {
+        return -1;
+    }
+    /* Every record takes at least two bytes */
+    *records = malloc(((len - CAPTURE_HEADER_LEN) / 2 + 1) * sizeof(**records));
+    if (*records == NULL) {
+        return -1;
+    }
+    capture_codec_reset(&codec);
+    while (offset < len) {
+        size_t used = capture_decode(&codec, data + offset, len - offset, &(*records)[count]);
+        if (used == 0) {
+            fprintf(stderr, "warning: stopped at invalid record, offset %zu\n", offset);
+            break;
+        }
+        offset += used;
+        count++;
+    }
+    return count;
+}
+
+
+/* Events at the same time run in this order */
+enum replay_event {
+    REPLAY_SAMPLE,
+    REPLAY_SINK,
+    REPLAY_NOTIFY,
+};
+
+static void replay(const struct capture_record *records, long count,
+                   const struct replay_params *params, struct replay_result *result)
+{
+    /* The producer starts from the ULP's first result without publishing it */
+    struct replay_change filter = {
+        .tolerance = params->adc_change_tol,
+        .previous = count > 0 ? records[0].value : 0,
+    };
+    struct replay_queue sink_queue = {0};
+    struct pipeline_stage source = {
+        .name = "ulp",
+        .source = ulp_source_poll,
+        .batch_ms = (uint16_t)params->batch_ms,
+    };
+    struct pipeline_stage change = {
+        .name = "change",
+        .process = change_filter_process,
+        .ctx = &filter,
+    };
+    struct pipeline_stage sink = {
+        .name = "gatt",
+        .process = gatt_sink_process,
+        .period_ms = gatt_sink_period_ms,
+        .queue_len = VALUE_QUEUE_LEN,
+        .ctx = (void *)params,
+        .input = &sink_queue,
+    };
+    struct notify_schedule schedule;
+    struct potentiometer_snapshot snapshot;
+    uint8_t payload[POTENTIOMETER_PAYLOAD_LEN];
+    static volatile uint8_t sink_byte;
+
+    *result = (struct replay_result){0};
+    if (count == 0) {
+        return;
+    }
+    result->samples = count;
+    result->duration_us = records[count - 1].timestamp_us - records[0].timestamp_us;
+
+    pipeline_connect(&source, &change);
+    pipeline_connect(&change, &sink);
+    replay_sim.free_count = 0;
+    for (int i = 0; i < PIPELINE_POOL_LEN; i++) {
+        pipeline_port_release(&replay_sim.pool[i]);
+    }
+
+    long next_sample = 1;
+    int64_t start_us = records[0].timestamp_us;
+    int64_t end_us = records[count - 1].timestamp_us +
+                     2000 * (int64_t)(params->dequeue_wait_ms + params->notify_period_ms);
+    replay_sim.sink_us = INT64_MAX;
+    replay_sim.notify_us = start_us;
+
+    /* The latch keeps the last capture's snapshot; only what this one publishes counts */
+    snapshot_read(&snapshot);
+    notify_schedule_start(&schedule, &params->subscription, params->notify_period_ms, snapshot.seq,
+                          (uint32_t)(start_us / 1000));
+
+    uint64_t cpu_start = host_ns();
+    while (true) {
+        int64_t sample_us = next_sample < count ? records[next_sample].timestamp_us : INT64_MAX;
+        enum replay_event event = REPLAY_SAMPLE;
+        int64_t now_us = sample_us;
+        if (replay_sim.sink_us < now_us) {
+            event = REPLAY_SINK;
+            now_us = replay_sim.sink_us;
+        }
+        if (replay_sim.notify_us < now_us) {
+            event = REPLAY_NOTIFY;
+            now_us = replay_sim.notify_us;
+        }
+        if (now_us > end_us) {
+            break;
+        }
+        replay_sim.now_us = now_us;
+
+        switch (event) {
+        case REPLAY_SAMPLE:
+            /* One poll of the ULP source's task, which polls again when the next record was taken */
+            replay_sim.record = &records[next_sample++];
+            pipeline_poll(&source, next_sample < count
+                                   ? (uint32_t)((records[next_sample].timestamp_us - now_us) / 1000)
+                                   : UINT32_MAX);
+            break;
+
+        case REPLAY_SINK: {
+            /* One pass of the GATT sink's task: drain the queue, then pause */
+            struct pipeline_batch *batch = pipeline_port_receive(&sink);
+            if (batch == NULL) {
+                replay_sim.sink_us = INT64_MAX;
+                break;
+            }
+            replay_sim.sink_us = now_us + 1000 * (int64_t)pipeline_drain(&sink, batch);
+            break;
+        }
+
+        case REPLAY_NOTIFY: {
+            /* One pass of the notify task over the subscription */
+            uint32_t now_ms = (uint32_t)(now_us / 1000);
+            snapshot_read(&snapshot);
+            notify_schedule_update(&schedule, &snapshot, now_ms);
+            if (schedule.pending) {
+                snapshot_encode(&snapshot, payload);
+                sink_byte = payload[0];
+                result->notifications++;
+                if (notify_schedule_sent(&schedule, &snapshot, now_ms)) {
+                    int64_t latency_us = now_us - snapshot.timestamp_us;
+                    result->fresh++;
+                    result->latency_total_us += latency_us;
+                    if (latency_us > result->latency_max_us) {
+                        result->latency_max_us = latency_us;
+                    }
+                }
+            }
+            uint32_t wait_ms = notify_schedule_wait_ms(&schedule, now_ms, params->notify_period_ms);
+            replay_sim.notify_us = now_us + 1000 * (int64_t)(wait_ms > 0 ? wait_ms : 1);
+            break;
+        }
+        }
+    }
+    result->cpu_ns = host_ns() - cpu_start;
+    (void)sink_byte;
+
+    result->changes = change.stats.items - change.stats.drops;
+    result->queue_full = sink.stats.drops;
+    result->published = sink.stats.items;
+}
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-t tolerance] [-d dequeue_ms] [-B batch_ms] [-n notify_ms] [-m heartbeat_ms (0: none)] "
+                    "[-b deadband] capture...\n", program);
+    exit(2);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct replay_params params = {
+        .adc_change_tol = ADC_CHANGE_TOL,
+        .dequeue_wait_ms = DEQUEUE_WAIT_MS,
+        .notify_period_ms = BLE_NOTIFICATION_PERIOD_MS,
+        .batch_ms = PRODUCER_BATCH_MS,
+    };
+    int option;
+
+    while ((option = getopt(argc, argv, "t:d:B:n:m:b:")) != -1) {
+        switch (option) {
+        case 't':
+            params.adc_change_tol = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            params.dequeue_wait_ms = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            params.batch_ms = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            params.notify_period_ms = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'm': {
+            unsigned long heartbeat_ms = strtoul(optarg, NULL, 0);
+            params.subscription.max_interval_ms = heartbeat_ms ? (uint16_t)heartbeat_ms : NOTIFY_HEARTBEAT_OFF;
+            break;
+        }
+        case 'b':
+            params.subscription.deadband = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc || params.dequeue_wait_ms == 0 || params.batch_ms > UINT16_MAX || params.notify_period_ms == 0 ||
+        !notify_params_valid(&params.subscription)) {
+        usage(argv[0]);
+    }
+
+    /* As the firmware resolves them; a connection that leaves max_interval_ms at 0
+     * gets a heartbeat at the notify period */
+    uint32_t heartbeat_ms = params.subscription.max_interval_ms;
+    if (heartbeat_ms == NOTIFY_HEARTBEAT_OFF) {
+        heartbeat_ms = 0;
+    } else if (heartbeat_ms == 0 || heartbeat_ms < params.notify_period_ms) {
+        heartbeat_ms = params.notify_period_ms;
+    }
+
+    int status = 0;
+    printf("capture,tolerance,dequeue_ms,batch_ms,notify_ms,heartbeat_ms,deadband,samples,duration_ms,changes,queue_full,"
+           "published,notifications,fresh,latency_mean_us,latency_max_us,cpu_us,cpu_ns_per_sample\n");
+    for (int i = optind; i < argc; i++) {
+        size_t len;
+        uint8_t *data = read_file(argv[i], &len);
+        struct capture_record *records = NULL;
+        long count = data ? decode_capture(data, len, &records) : -1;
+        free(data);
+        if (count < 0) {
+            fprintf(stderr, "%s: not a capture file\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        struct replay_result result;
+        replay(records, count, &params, &result);
+        free(records);
+
+        printf("%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%u,%" PRIu32 ",%lld,%" PRIu32 ",%" PRIu32
+               ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%lld,%lld,%llu,%llu\n",
+               argv[i], params.adc_change_tol, params.dequeue_wait_ms, params.batch_ms, params.notify_period_ms,
+               heartbeat_ms, params.subscription.deadband,
+               result.samples, (long long)(result.duration_us / 1000), result.changes,
+               result.queue_full, result.published, result.notifications, result.fresh,
+               (long long)(result.fresh ? result.latency_total_us / result.fresh : 0),
+               (long long)result.latency_max_us,
+               (unsigned long long)(result.cpu_ns / 1000),
+               (unsigned long long)(result.samples ? result.cpu_ns / result.samples : 0));
+    }
+    return status;
+}
@@ -0,0 +1,250 @@
+/* Host simulation of the time sync service (see main/clock_sync.h)
+
+Runs sync exchanges between a simulated central and a device whose RTC ticks
+run off the calibrated rate by a drift, which may itself ramp over time, across
+a BLE link that only moves packets at connection events and adds random delay
+on both sides. The exchanges feed the firmware's own estimator
+(main/sync_estimator.c); between exchanges, samples stamped with the device's
+RTC ticks are mapped to central time and compared with the true time.
+
+    ./build-bench/sync_host [-d drift_ppm] [-r ramp_ppm_per_min] [-j jitter_us]
+                            [-i interval_ms] [-p period_ms] [-n exchanges] [-s seed]
+
+Prints one CSV row. Exits with status 1 if any sample was further from the true
+time than the error bound the model reported for it, if no sample could be
+mapped at all, or if more than SIM_MAX_REJECTED_PCT of the exchanges were
+rejected.
+*/
+
+/* Standard headers */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Application module headers */
+#include "sync_estimator.h"
+
+#define SIM_RTC_HZ            150000.0      // Calibrated RTC slow clock rate
+#define SIM_TICKS_AT_BOOT     0xFFF00000u   // So the 32-bit tick count wraps early on
+#define SIM_CENTRAL_EPOCH_US  1700000000000000LL  // Central clock at simulated time 0
+#define SIM_AIR_US            400.0         // Packet on air, both directions
+#define SIM_PROCESSING_US     150.0         // Device time from request to reply
+#define SIM_SAMPLES_PER_EXCHANGE 20
+#define SIM_MAX_REJECTED_PCT  10
+
+struct sim_params {
+    double drift_ppm;      // RTC rate off its calibration
+    double ramp_ppm_min;   // Change of the drift per minute
+    double jitter_us;      // Mean of the random delays added by each side
+    double interval_us;    // BLE connection interval
+    double period_us;      // Between sync exchanges
+    uint32_t exchanges;
+    uint64_t seed;
+};
+
+struct sim_result {
+    uint32_t samples;
+    uint32_t mapped;       // Samples taken while the model was valid
+    uint32_t violations;   // Samples further off than their bound
+    double error_sum;
+    double error_sum_sq;
+    double error_max;
+    double bound_sum;
+    uint32_t bound_max;
+};
+
+static uint64_t sim_rng;
+
+
+/* xorshift64*, uniform in [0, 1) */
+static double uniform(void)
+{
+    sim_rng ^= sim_rng >> 12;
+    sim_rng ^= sim_rng << 25;
+    sim_rng ^= sim_rng >> 27;
+    return (double)((sim_rng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+
+static double exponential(double mean)
+{
+    return mean > 0 ? -mean * log(1 - uniform()) : 0;
+}
+
+
+/* Device RTC ticks at true time t_us */
+static uint32_t device_ticks(const struct sim_params *params, double t_us)
+{
+    double minutes = t_us / 60e6;
+    double ppm = params->drift_ppm + params->ramp_ppm_min * minutes / 2;
+    double ticks = t_us * SIM_RTC_HZ / 1e6 * (1 + ppm * 1e-6);
+    return SIM_TICKS_AT_BOOT + (uint32_t)(uint64_t)floor(ticks);
+}
+
+
+static int64_t central_clock(double t_us)
+{
+    return SIM_CENTRAL_EPOCH_US + (int64_t)floor(t_us);
+}
+
+
+/* First connection event at or after t_us */
+static double next_event(const struct sim_params *params, double t_us)
+{
+    return ceil(t_us / params->interval_us) * params->interval_us;
+}
+
+
+/* One request and reply over the link, starting at true time t_us */
+static void exchange(const struct sim_params *params, double t_us, struct sync_exchange *result)
+{
+    double sent = t_us;
+    double received = next_event(params, sent + exponential(params->jitter_us)) + SIM_AIR_US
+                      + exponential(params->jitter_us);
+    double replied = received + SIM_PROCESSING_US;
+    double returned = next_event(params, replied) + SIM_AIR_US + exponential(params->jitter_us);
+    /* Now and then a packet is lost and retransmitted at the next event */
+    if (uniform() < 0.05) {
+        returned += params->interval_us;
+    }
+
+    result->send_us = central_clock(sent);
+    result->receive_ticks = device_ticks(params, received);
+    result->reply_ticks = device_ticks(params, replied);
+    result->return_us = central_clock(returned);
+}
+
+
+static void simulate(const struct sim_params *params, struct sync_estimator *estimator,
+                     struct sim_result *result)
+{
+    sync_estimator_reset(estimator, 1e6 / SIM_RTC_HZ);
+    sync_estimator_set_interval(estimator, (uint32_t)params->interval_us);
+    *result = (struct sim_result){0};
+    sim_rng = params->seed ? params->seed : 1;
+
+    double returned_us = 0;
+    for (uint32_t i = 0; i < params->exchanges; i++) {
+        /* Like bench/clock_sync.py, the central waits for the reply before it
+         * sends the next request */
+        double start_us = i * params->period_us + uniform() * params->interval_us;
+        if (start_us < returned_us) {
+            start_us = returned_us;
+        }
+        struct sync_exchange round_trip;
+        exchange(params, start_us, &round_trip);
+        returned_us = (double)(round_trip.return_us - SIM_CENTRAL_EPOCH_US);
+        sync_estimator_add(estimator, &round_trip);
+
+        /* Samples until the next exchange, mapped with the model as it is now */
+        for (int j = 0; j < SIM_SAMPLES_PER_EXCHANGE; j++) {
+            double t_us = start_us + uniform() * params->period_us;
+            int64_t time_us;
+            uint32_t bound_us;
+            result->samples++;
+            if (!sync_model_map(&estimator->model, device_ticks(params, t_us), &time_us, &bound_us)) {
+                continue;
+            }
+            double error = fabs((double)(time_us - central_clock(t_us)));
+            result->mapped++;
+            result->error_sum += error;
+            result->error_sum_sq += error * error;
+            result->bound_sum += bound_us;
+            if (error > result->error_max) {
+                result->error_max = error;
+            }
+            if (bound_us > result->bound_max) {
+                result->bound_max = bound_us;
+            }
+            if (error > bound_us) {
+                result->violations++;
+            }
+        }
+    }
+}
+
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-d drift_ppm] [-r ramp_ppm_per_min] [-j jitter_us] [-i interval_ms] "
+                    "[-p period_ms] [-n exchanges] [-s seed]\n", program);
+    exit(2);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct sim_params params = {
+        .drift_ppm = 500,
+        .ramp_ppm_min = 0,
+        .jitter_us = 500,
+        .interval_us = 30000,
+        .period_us = 1000000,
+        .exchanges = 600,
+        .seed = 1,
+    };
+    int option;
+
+    while ((option = getopt(argc, argv, "d:r:j:i:p:n:s:")) != -1) {
+        switch (option) {
+        case 'd':
+            params.drift_ppm = strtod(optarg, NULL);
+            break;
+        case 'r':
+            params.ramp_ppm_min = strtod(optarg, NULL);
+            break;
+        case 'j':
+            params.jitter_us = strtod(optarg, NULL);
+            break;
+        case 'i':
+            params.interval_us = strtod(optarg, NULL) * 1000;
+            break;
+        case 'p':
+            params.period_us = strtod(optarg, NULL) * 1000;
+            break;
+        case 'n':
+            params.exchanges = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            params.seed = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || params.jitter_us < 0 || params.interval_us <= 0 || params.period_us <= 0) {
+        usage(argv[0]);
+    }
+
+    static struct sync_estimator estimator;
+    struct sim_result result;
+    simulate(&params, &estimator, &result);
+    const struct sync_stats *stats = &estimator.stats;
+
+    printf("drift_ppm,ramp_ppm_min,jitter_us,interval_ms,period_ms,exchanges,rejected,fitted,"
+           "estimated_drift_ppm,min_delay_us,prediction_rms_us,prediction_max_us,samples,mapped,"
+           "error_mean_us,error_rms_us,error_max_us,bound_mean_us,bound_max_us,violations\n");
+    printf("%.1f,%.2f,%.0f,%.1f,%.0f,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%.3f,%" PRIu32 ",%" PRIu32
+           ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%.1f,%.1f,%.0f,%.1f,%" PRIu32 ",%" PRIu32 "\n",
+           params.drift_ppm, params.ramp_ppm_min, params.jitter_us, params.interval_us / 1000,
+           params.period_us / 1000, stats->exchanges, stats->rejected, stats->fitted,
+           stats->drift_ppb / 1000.0, stats->min_delay_us, stats->rms_error_us, stats->max_error_us,
+           result.samples, result.mapped,
+           result.mapped ? result.error_sum / result.mapped : 0,
+           result.mapped ? sqrt(result.error_sum_sq / result.mapped) : 0,
+           result.error_max,
+           result.mapped ? result.bound_sum / result.mapped : 0,
+           result.bound_max, result.violations);
+    if (result.mapped == 0) {
+        fprintf(stderr, "no sample was mapped to central time\n");
+        return 1;
+    }
+    if ((uint64_t)stats->rejected * 100 > (uint64_t)params.exchanges * SIM_MAX_REJECTED_PCT) {
+        fprintf(stderr, "%" PRIu32 " of %" PRIu32 " exchanges rejected\n", stats->rejected,
+                params.exchanges);
+        return 1;
+    }
+    return result.violations > 0 ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Multi-central load generator for the potentiometer GATT server.
+
+Runs a number of virtual centrals against the device, each repeatedly
+connecting, subscribing to FFF1, reading it and disconnecting at the configured
+rates, and reports what the centrals observed: connection setup time and
+failures, notification rate and inter-arrival jitter, and read round trip time.
+
+The device reports the other side of the picture (delivery latency from sample
+capture, drops, retries and NimBLE host task CPU) in its periodic "load:" log
+line, see BLE_STATS_PERIOD_MS in main/ble.h.
+
+BlueZ allows only one connection per adapter to a given device, so each
+concurrent central needs its own adapter (e.g. several USB dongles). Centrals
+are assigned to the adapters round robin.
+
+    pip install bleak
+    python3 bench/load_test.py --adapters hci0,hci1,hci2 --centrals 3 --duration 120
+
+Requires Linux with BlueZ.
+"""
+import argparse
+import asyncio
+import json
+import statistics
+import time
+
+from bleak import BleakClient, BleakScanner
+
+POTENTIOMETER_CHR_UUID = "0000fff1-0000-1000-8000-00805f9b34fb"
+
+
+class CentralStats:
+    def __init__(self, index, adapter):
+        self.index = index
+        self.adapter = adapter
+        self.connects = 0
+        self.connect_failures = 0
+        self.connect_times = []
+        self.notifications = 0
+        self.subscribed_s = 0.0
+        self.intervals = []
+        self.read_rtts = []
+        self.read_failures = 0
+
+    def summary(self):
+        def ms(values, fn):
+            return round(fn(values) * 1000, 1) if values else None
+
+        return {
+            "central": self.index,
+            "adapter": self.adapter,
+            "connects": self.connects,
+            "connect_failures": self.connect_failures,
+            "connect_ms_mean": ms(self.connect_times, statistics.mean),
+            "notifications": self.notifications,
+            "notify_rate_hz": round(self.notifications / self.subscribed_s, 2) if self.subscribed_s else None,
+            "notify_interval_ms_mean": ms(self.intervals, statistics.mean),
+            "notify_jitter_ms": ms(self.intervals, statistics.pstdev),
+            "read_rtt_ms_mean": ms(self.read_rtts, statistics.mean),
+            "read_rtt_ms_max": ms(self.read_rtts, max),
+            "read_failures": self.read_failures,
+        }
+
+
+async def run_central(stats, device, args, deadline):
+    """Connect/subscribe/read/disconnect cycles until the deadline."""
+    # Stagger the centrals so they don't all connect at once
+    await asyncio.sleep(stats.index * args.stagger)
+    while time.monotonic() < deadline:
+        last_arrival = None
+
+        def on_notify(_sender, _data):
+            nonlocal last_arrival
+            now = time.monotonic()
+            if last_arrival is not None:
+                stats.intervals.append(now - last_arrival)
+            last_arrival = now
+            stats.notifications += 1
+
+        start = time.monotonic()
+        try:
+            async with BleakClient(device, adapter=stats.adapter, timeout=args.connect_timeout) as client:
+                stats.connects += 1
+                stats.connect_times.append(time.monotonic() - start)
+
+                await client.start_notify(POTENTIOMETER_CHR_UUID, on_notify)
+                subscribed = time.monotonic()
+                hold_until = min(subscribed + args.hold, deadline)
+                while time.monotonic() < hold_until:
+                    read_start = time.monotonic()
+                    try:
+                        await client.read_gatt_char(POTENTIOMETER_CHR_UUID)
+                        stats.read_rtts.append(time.monotonic() - read_start)
+                    except Exception:
+                        stats.read_failures += 1
+                    await asyncio.sleep(1.0 / args.read_rate if args.read_rate > 0 else hold_until - time.monotonic())
+                stats.subscribed_s += time.monotonic() - subscribed
+                await client.stop_notify(POTENTIOMETER_CHR_UUID)
+        except Exception:
+            stats.connect_failures += 1
+        await asyncio.sleep(args.churn_delay)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--name", default="NimBLE_GATT", help="advertised device name (default: %(default)s)")
+    parser.add_argument("--address", help="device address, skips scanning by name")
+    parser.add_argument("--adapters", default="hci0", help="comma separated BlueZ adapters (default: %(default)s)")
+    parser.add_argument("--centrals", type=int, default=1, help="number of virtual centrals (default: %(default)s)")
+    parser.add_argument("--duration", type=float, default=60.0, help="test length in seconds (default: %(default)s)")
+    parser.add_argument("--hold", type=float, default=10.0, help="seconds each connection stays up (default: %(default)s)")
+    parser.add_argument("--churn-delay", type=float, default=1.0, help="seconds between disconnect and reconnect (default: %(default)s)")
+    parser.add_argument("--read-rate", type=float, default=1.0, help="FFF1 reads per second while connected, 0 for none (default: %(default)s)")
+    parser.add_argument("--stagger", type=float, default=0.5, help="seconds between central start times (default: %(default)s)")
+    parser.add_argument("--connect-timeout", type=float, default=10.0, help="connection timeout in seconds (default: %(default)s)")
+    args = parser.parse_args()
+
+    adapters = args.adapters.split(",")
+    if args.address:
+        device = args.address
+    else:
+        found = await BleakScanner.find_device_by_name(args.name, timeout=10.0, adapter=adapters[0])
+        if found is None:
+            raise SystemExit(f"device {args.name!r} not found")
+        device = found.address
+
+    stats = [CentralStats(i, adapters[i % len(adapters)]) for i in range(args.centrals)]
+    deadline = time.monotonic() + args.duration
+    await asyncio.gather(*(run_central(s, device, args, deadline) for s in stats))
+
+    print(json.dumps({"device": device, "centrals": [s.summary() for s in stats]}, indent=2))
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
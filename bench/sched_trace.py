@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Convert a scheduler trace capture into Chrome trace / Perfetto JSON.
+
+The input is the serial log of a firmware built with SCHED_TRACE_ENABLED (see
+main/sched_trace.h). Everything outside the SCHED_TRACE_BEGIN/END markers is
+ignored, so the whole console log can be passed directly.
+
+    python3 bench/sched_trace.py console.log -o trace.json
+
+Open trace.json in https://ui.perfetto.dev or chrome://tracing. Each core is a
+track with one slice per task run, and task wake-ups, watched queue operations
+and pipeline events are shown as instants. A per-task summary of run times and
+response times (ready to running) is printed to stderr.
+"""
+import argparse
+import json
+import sys
+from collections import defaultdict
+
+
+def parse(lines):
+    tasks = {}
+    queues = {}
+    events = []
+    capturing = False
+    for line in lines:
+        line = line.strip()
+        if line.endswith("SCHED_TRACE_BEGIN"):
+            capturing = True
+            continue
+        if line.endswith("SCHED_TRACE_END"):
+            break
+        if not capturing:
+            continue
+        fields = line.split(",")
+        if fields[0] == "TASK" and len(fields) == 4:
+            tasks[int(fields[1], 16)] = (fields[2], int(fields[3]))
+        elif fields[0] == "QUEUE" and len(fields) == 3:
+            queues[int(fields[1])] = fields[2]
+        elif fields[0] == "EV" and len(fields) == 7:
+            events.append({
+                "ts": int(fields[1]),
+                "core": int(fields[2]),
+                "type": fields[3],
+                "id": int(fields[4]),
+                "name": fields[5],
+                "arg": int(fields[6], 16),
+            })
+    if not events:
+        sys.exit("no scheduler trace found in input")
+    return tasks, queues, sorted(events, key=lambda e: e["ts"])
+
+
+def task_name(tasks, handle):
+    return tasks.get(handle, (f"task 0x{handle:08x}", 0))[0]
+
+
+def convert(tasks, queues, events):
+    trace = []
+    stats = defaultdict(lambda: {"runs": 0, "total_us": 0, "max_us": 0, "max_response_us": 0})
+    running = {}      # core -> (task handle, start)
+    ready_since = {}  # task handle -> time it became ready
+    end = events[-1]["ts"]
+
+    def close_slice(core, ts):
+        if core not in running:
+            return
+        handle, start = running.pop(core)
+        name = task_name(tasks, handle)
+        trace.append({"ph": "X", "name": name, "pid": 0, "tid": core, "ts": start, "dur": ts - start,
+                      "args": {"priority": tasks.get(handle, (None, None))[1]}})
+        entry = stats[name]
+        entry["runs"] += 1
+        entry["total_us"] += ts - start
+        entry["max_us"] = max(entry["max_us"], ts - start)
+
+    for ev in events:
+        core, ts = ev["core"], ev["ts"]
+        if ev["type"] == "switch_in":
+            close_slice(core, ts)
+            running[core] = (ev["arg"], ts)
+            ready = ready_since.pop(ev["arg"], None)
+            if ready is not None:
+                entry = stats[task_name(tasks, ev["arg"])]
+                entry["max_response_us"] = max(entry["max_response_us"], ts - ready)
+        elif ev["type"] == "ready":
+            ready_since.setdefault(ev["arg"], ts)
+            trace.append({"ph": "i", "s": "t", "name": f"ready: {task_name(tasks, ev['arg'])}",
+                          "pid": 0, "tid": core, "ts": ts})
+        elif ev["type"] in ("queue_send", "queue_receive"):
+            queue = queues.get(ev["id"], f"queue {ev['id']}")
+            trace.append({"ph": "i", "s": "t", "name": f"{ev['type']}: {queue}", "pid": 0, "tid": core,
+                          "ts": ts})
+        elif ev["type"] == "pipeline":
+            trace.append({"ph": "i", "s": "t", "name": ev["name"] or f"event {ev['id']}", "pid": 0,
+                          "tid": core, "ts": ts, "args": {"arg0": ev["arg"]}})
+
+    for core in list(running):
+        close_slice(core, end)
+
+    for core in sorted({ev["core"] for ev in events}):
+        trace.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": core, "args": {"name": f"core {core}"}})
+    trace.append({"ph": "M", "name": "process_name", "pid": 0, "args": {"name": "ESP32"}})
+    return trace, stats, end - events[0]["ts"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", type=argparse.FileType("r"), help="serial console log ('-' for stdin)")
+    parser.add_argument("-o", "--output", default="sched_trace.json",
+                        help="Chrome trace JSON file to write (default: %(default)s)")
+    args = parser.parse_args()
+
+    tasks, queues, events = parse(args.log)
+    trace, stats, duration = convert(tasks, queues, events)
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": trace, "displayTimeUnit": "ms"}, f)
+
+    print(f"{len(events)} events over {duration / 1000:.1f} ms written to {args.output}", file=sys.stderr)
+    print(f"{'task':20} {'runs':>6} {'total_us':>10} {'cpu%':>6} {'max_run_us':>10} {'max_resp_us':>11}",
+          file=sys.stderr)
+    for name, entry in sorted(stats.items(), key=lambda item: -item[1]["total_us"]):
+        share = 100.0 * entry["total_us"] / duration if duration else 0.0
+        print(f"{name:20} {entry['runs']:6} {entry['total_us']:10} {share:6.1f} {entry['max_us']:10} "
+              f"{entry['max_response_us']:11}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
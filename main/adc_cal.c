@@ -0,0 +1,114 @@
+/* Implementations for adc_cal.h */
+
+/* Header */
+#include "adc_cal.h"
+
+/* Standard headers */
+#include <stddef.h>
+
+/* ESP-IDF headers */
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+
+/* ULP config */
+#include "ulp/ulp_config.h"
+
+/* Application module headers */
+#include "adc_lut.h"
+
+#define ADC_CAL_LOG_NAME "ADC_CAL"
+
+/* Private variables */
+static struct adc_lut adc_cal_lut;
+
+
+/* Calibration curve from the eFuse calibration scheme */
+static int efuse_curve(int raw, void *context)
+{
+    int mv = 0;
+    if (adc_cali_raw_to_voltage((adc_cali_handle_t)context, raw, &mv) != ESP_OK) {
+        return 0;
+    }
+    return mv;
+}
+
+
+/* Nominal curve for chips without calibration data */
+static int nominal_curve(int raw, void *context)
+{
+    (void)context;
+    return raw * ADC_CAL_UNCALIBRATED_FULL_SCALE_MV / (ADC_LUT_SIZE - 1);
+}
+
+
+/* Create the calibration scheme the chip supports */
+static esp_err_t create_scheme(adc_cali_handle_t *handle)
+{
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_curve_fitting_config_t cfg = {
+        .unit_id  = ULP_ADC_UNIT,
+        .chan     = ULP_ADC_CHANNEL,
+        .atten    = ULP_ADC_ATTEN,
+        .bitwidth = ULP_ADC_BITWIDTH,
+    };
+    return adc_cali_create_scheme_curve_fitting(&cfg, handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_line_fitting_config_t cfg = {
+        .unit_id  = ULP_ADC_UNIT,
+        .atten    = ULP_ADC_ATTEN,
+        .bitwidth = ULP_ADC_BITWIDTH,
+#if CONFIG_IDF_TARGET_ESP32
+        .default_vref = ADC_CAL_DEFAULT_VREF_MV,
+#endif
+    };
+    return adc_cali_create_scheme_line_fitting(&cfg, handle);
+#else
+    (void)handle;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+
+/* Release the calibration scheme once the table is built */
+static void delete_scheme(adc_cali_handle_t handle)
+{
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_delete_scheme_curve_fitting(handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_delete_scheme_line_fitting(handle);
+#else
+    (void)handle;
+#endif
+}
+
+
+void adc_cal_init(void)
+{
+    adc_cali_handle_t handle = NULL;
+    esp_err_t err = create_scheme(&handle);
+    if (err == ESP_OK) {
+        adc_lut_build(&adc_cal_lut, efuse_curve, handle);
+        delete_scheme(handle);
+        ESP_LOGI(ADC_CAL_LOG_NAME, "using eFuse ADC calibration");
+    } else {
+        ESP_LOGW(ADC_CAL_LOG_NAME, "no ADC calibration available (%s), using nominal curve",
+                 esp_err_to_name(err));
+        adc_lut_build(&adc_cal_lut, nominal_curve, NULL);
+    }
+    ESP_LOGI(ADC_CAL_LOG_NAME, "ADC range %u to %u mV", adc_cal_lut.mv[0], adc_cal_lut.mv[ADC_LUT_SIZE - 1]);
+}
+
+
+uint16_t adc_cal_millivolts(uint16_t raw)
+{
+    return adc_lut_millivolts(&adc_cal_lut, raw);
+}
+
+
+uint16_t adc_cal_percent(uint16_t raw)
+{
+    return adc_lut_percent(&adc_cal_lut, raw);
+}
@@ -0,0 +1,25 @@
+/* Calibrated conversion of the ULP's ADC codes
+
+The chip's eFuse calibration for the ADC unit and attenuation used by the ULP
+(see ulp/ulp_config.h) is read once at boot and turned into a millivolt lookup
+table. If the chip has no calibration burnt in, a nominal linear curve is used
+instead and values will be less accurate.
+*/
+#ifndef ADC_CAL_H
+#define ADC_CAL_H
+
+#include <inttypes.h>
+
+#define ADC_CAL_DEFAULT_VREF_MV           1100  // ESP32 line fitting reference when no Vref is burnt in eFuse
+#define ADC_CAL_UNCALIBRATED_FULL_SCALE_MV 3100  // Nominal full scale at 12 dB attenuation
+
+/* Build the lookup table. Call once before any conversion */
+void adc_cal_init(void);
+
+/* Millivolts for an averaged ADC code */
+uint16_t adc_cal_millivolts(uint16_t raw);
+
+/* Dial position for an averaged ADC code in hundredths of a percent (0 to 10000) */
+uint16_t adc_cal_percent(uint16_t raw);
+
+#endif // ADC_CAL_H
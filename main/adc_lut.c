@@ -0,0 +1,38 @@
+/* Implementations for adc_lut.h */
+
+/* Header */
+#include "adc_lut.h"
+
+
+void adc_lut_build(struct adc_lut *lut, adc_lut_curve_fn curve, void *context)
+{
+    int previous = 0;
+    for (int raw = 0; raw < ADC_LUT_SIZE; raw++) {
+        int mv = curve(raw, context);
+        if (mv < previous) {
+            mv = previous;
+        }
+        if (mv > UINT16_MAX) {
+            mv = UINT16_MAX;
+        }
+        lut->mv[raw] = (uint16_t)mv;
+        previous = mv;
+    }
+}
+
+
+uint16_t adc_lut_millivolts(const struct adc_lut *lut, uint32_t raw)
+{
+    return lut->mv[(raw < ADC_LUT_SIZE) ? raw : ADC_LUT_SIZE - 1];
+}
+
+
+uint16_t adc_lut_percent(const struct adc_lut *lut, uint32_t raw)
+{
+    uint32_t lowest = lut->mv[0];
+    uint32_t range = lut->mv[ADC_LUT_SIZE - 1] - lowest;
+    if (range == 0) {
+        return 0;
+    }
+    return (uint16_t)((adc_lut_millivolts(lut, raw) - lowest) * ADC_LUT_PERCENT_SCALE / range);
+}
@@ -0,0 +1,34 @@
+/* ADC code to millivolt lookup table
+
+The table is built once from a calibration curve (see adc_cal.h) so converting a
+sample is a single lookup with no float math. These functions have no ESP-IDF
+dependencies so they also build on the host (see bench/host).
+*/
+#ifndef ADC_LUT_H
+#define ADC_LUT_H
+
+#include <inttypes.h>
+
+#define ADC_LUT_BITS           12  // ADC_BITWIDTH_DEFAULT on the ESP32 and ESP32-S3
+#define ADC_LUT_SIZE           (1 << ADC_LUT_BITS)
+#define ADC_LUT_PERCENT_SCALE  10000  // Position reported in hundredths of a percent
+
+/* Calibration curve: millivolts for an ADC code */
+typedef int (*adc_lut_curve_fn)(int raw, void *context);
+
+struct adc_lut {
+    uint16_t mv[ADC_LUT_SIZE];
+};
+
+/* Fill the table from a calibration curve. Entries are clamped to uint16_t and
+ * kept non-decreasing so the derived position never runs backwards */
+void adc_lut_build(struct adc_lut *lut, adc_lut_curve_fn curve, void *context);
+
+/* Millivolts for an ADC code. Codes beyond the table are clamped to the last entry */
+uint16_t adc_lut_millivolts(const struct adc_lut *lut, uint32_t raw);
+
+/* Dial position for an ADC code, 0 to ADC_LUT_PERCENT_SCALE, linear in voltage
+ * between the lowest and highest voltage the ADC can report */
+uint16_t adc_lut_percent(const struct adc_lut *lut, uint32_t raw);
+
+#endif // ADC_LUT_H
@@ -0,0 +1,174 @@
+/* Implementations for app_config.h */
+
+/* Header */
+#include "app_config.h"
+
+/* Standard headers */
+#include <stddef.h>
+#include <string.h>
+
+/* ESP-IDF headers */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+/* Application module headers */
+#include "ble.h"
+#include "consumer.h"
+#include "gap.h"
+#include "producer.h"
+#include "seqlock.h"
+
+#define APP_CONFIG_LOG_NAME "APP_CONFIG"
+
+_Static_assert(sizeof(struct app_config) == 4 + 2 * ULP_WAKE_PERIOD_COUNT + 8,
+               "struct app_config must not contain padding");
+
+/* Private variables */
+static struct seqlock app_config_lock;
+static struct app_config app_config_copies[2];
+static TaskHandle_t app_config_save_task_handle;
+
+static const struct app_config app_config_defaults = {
+    .version = APP_CONFIG_VERSION,
+    .adc_change_tol = ADC_CHANGE_TOL,
+    .ulp_period_ms = ULP_WAKEUP_PERIODS_MS,
+    .dequeue_wait_ms = DEQUEUE_WAIT_MS,
+    .notify_period_ms = BLE_NOTIFICATION_PERIOD_MS,
+    .adv_itvl_min_ms = GAP_ADV_ITVL_MIN_MS,
+    .adv_itvl_max_ms = GAP_ADV_ITVL_MAX_MS,
+};
+
+
+/* Read the saved record. Returns false if there is none or it is not usable */
+static bool load(struct app_config *config)
+{
+    nvs_handle_t handle;
+    size_t size = sizeof(*config);
+
+    if (nvs_open(APP_CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(handle, APP_CONFIG_NVS_KEY, config, &size);
+    nvs_close(handle);
+
+    if (err != ESP_OK || size != sizeof(*config)) {
+        return false;
+    }
+    return app_config_validate(config);
+}
+
+
+static void save(const struct app_config *config)
+{
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(APP_CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, APP_CONFIG_NVS_KEY, config, sizeof(*config));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(APP_CONFIG_LOG_NAME, "failed to save configuration: %s", esp_err_to_name(err));
+    }
+}
+
+
+/* Save the record once writes have stopped for APP_CONFIG_SAVE_DELAY_MS */
+static void app_config_save_task(void *pvParameters)
+{
+    struct app_config saved;
+    struct app_config current;
+
+    app_config_get(&saved);
+    while (true) {
+        /* Wait for a write, then until no more writes arrive for the delay */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(APP_CONFIG_SAVE_DELAY_MS)) > 0) {
+        }
+
+        app_config_get(&current);
+        if (memcmp(&current, &saved, sizeof(current)) != 0) {
+            save(&current);
+            saved = current;
+            ESP_LOGI(APP_CONFIG_LOG_NAME, "configuration saved");
+        }
+    }
+}
+
+
+void app_config_init(void)
+{
+    struct app_config config;
+
+    if (load(&config)) {
+        ESP_LOGI(APP_CONFIG_LOG_NAME, "loaded saved configuration");
+    } else {
+        ESP_LOGI(APP_CONFIG_LOG_NAME, "no valid saved configuration, using defaults");
+        config = app_config_defaults;
+    }
+    seqlock_write(&app_config_lock, app_config_copies, &config, sizeof(config));
+
+    xTaskCreatePinnedToCore(
+        app_config_save_task,
+        "Config Save",
+        3072,
+        NULL,
+        1,
+        &app_config_save_task_handle,
+        0
+    );
+}
+
+
+void app_config_get(struct app_config *config)
+{
+    seqlock_read(&app_config_lock, app_config_copies, config, sizeof(*config));
+}
+
+
+bool app_config_validate(const struct app_config *config)
+{
+    if (config->version != APP_CONFIG_VERSION || config->reserved != 0) {
+        return false;
+    }
+    if (config->adc_change_tol >= (1 << 12)) {
+        return false;
+    }
+    for (int i = 0; i < ULP_WAKE_PERIOD_COUNT; i++) {
+        if (config->ulp_period_ms[i] < APP_CONFIG_ULP_PERIOD_MIN_MS ||
+            config->ulp_period_ms[i] > APP_CONFIG_ULP_PERIOD_MAX_MS ||
+            (i > 0 && config->ulp_period_ms[i] < config->ulp_period_ms[i - 1])) {
+            return false;
+        }
+    }
+    if (config->dequeue_wait_ms < APP_CONFIG_DEQUEUE_WAIT_MIN_MS ||
+        config->dequeue_wait_ms > APP_CONFIG_DEQUEUE_WAIT_MAX_MS) {
+        return false;
+    }
+    if (config->notify_period_ms < APP_CONFIG_NOTIFY_PERIOD_MIN_MS ||
+        config->notify_period_ms > APP_CONFIG_NOTIFY_PERIOD_MAX_MS) {
+        return false;
+    }
+    if (config->adv_itvl_min_ms < APP_CONFIG_ADV_ITVL_MIN_MS ||
+        config->adv_itvl_max_ms > APP_CONFIG_ADV_ITVL_MAX_MS ||
+        config->adv_itvl_min_ms > config->adv_itvl_max_ms) {
+        return false;
+    }
+    return true;
+}
+
+
+bool app_config_set(const struct app_config *config)
+{
+    if (!app_config_validate(config)) {
+        return false;
+    }
+    seqlock_write(&app_config_lock, app_config_copies, config, sizeof(*config));
+    xTaskNotifyGive(app_config_save_task_handle);
+    return true;
+}
@@ -0,0 +1,66 @@
+/* Runtime configuration
+
+All tuning parameters live in a single versioned record that can be read and
+written over BLE (see gatt_svc.c). A written record is validated as a whole and
+published through a seqlock, so every task picks up a consistent copy the next
+time it reads it and no reboot is needed. The record is cached in RAM and saved
+to NVS by a low priority task once writes have stopped for APP_CONFIG_SAVE_DELAY_MS,
+so a client tuning parameters doesn't cause a flash write (and cache stall) per write.
+*/
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "ulp/ulp_config.h"
+
+#define APP_CONFIG_VERSION        1     // Bump when the record layout changes
+#define APP_CONFIG_SAVE_DELAY_MS  2000  // Quiet time after the last write before saving to NVS
+#define APP_CONFIG_NVS_NAMESPACE  "app_config"
+#define APP_CONFIG_NVS_KEY        "record"
+/* 1: the record can only be written over an encrypted link, so a central has to
+ * pair first (Just Works, bonded; the device has no display or buttons, so this
+ * keeps out passive eavesdroppers and unpaired centrals, not an active attacker
+ * during pairing). 0: any connected central may write it */
+#define APP_CONFIG_WRITE_ENCRYPTED  1
+
+/* Limits enforced by app_config_validate */
+#define APP_CONFIG_ULP_PERIOD_MIN_MS     10
+#define APP_CONFIG_ULP_PERIOD_MAX_MS     60000
+#define APP_CONFIG_DEQUEUE_WAIT_MIN_MS   10
+#define APP_CONFIG_DEQUEUE_WAIT_MAX_MS   1000
+#define APP_CONFIG_NOTIFY_PERIOD_MIN_MS  20
+#define APP_CONFIG_NOTIFY_PERIOD_MAX_MS  10000
+#define APP_CONFIG_ADV_ITVL_MIN_MS       20     // Bluetooth Core spec range for advertising intervals
+#define APP_CONFIG_ADV_ITVL_MAX_MS       10240
+
+/* The configuration record, sent over BLE and stored in NVS as is (little-endian,
+ * laid out without padding) */
+struct app_config {
+    uint8_t version;                               // APP_CONFIG_VERSION
+    uint8_t reserved;                              // Must be 0
+    uint16_t adc_change_tol;                       // ADC change that triggers an update (ADC_CHANGE_TOL)
+    uint16_t ulp_period_ms[ULP_WAKE_PERIOD_COUNT]; // ULP wake periods, fastest first (ULP_WAKEUP_PERIODS_MS)
+    uint16_t dequeue_wait_ms;                      // Consumer poll period (DEQUEUE_WAIT_MS)
+    uint16_t notify_period_ms;                     // Fastest notify period (BLE_NOTIFICATION_PERIOD_MS)
+    uint16_t adv_itvl_min_ms;                      // Advertising interval range (GAP_ADV_ITVL_MIN_MS)
+    uint16_t adv_itvl_max_ms;                      // (GAP_ADV_ITVL_MAX_MS)
+};
+
+/* Load the record from NVS, falling back to the compiled-in defaults, and start
+ * the save task. NVS must be initialized; call before starting any other task */
+void app_config_init(void);
+
+/* Copy the current record. Safe to call from any task */
+void app_config_get(struct app_config *config);
+
+/* True if every field of config is in range */
+bool app_config_validate(const struct app_config *config);
+
+/* Validate and apply a new record and schedule saving it. Only one task (the
+ * NimBLE host) may call this. Returns false, leaving the current record in
+ * place, if config is invalid */
+bool app_config_set(const struct app_config *config);
+
+#endif // APP_CONFIG_H
@@ -0,0 +1,99 @@
+/* On-target benchmark runner declared in bench.h */
+
+/* Header */
+#include "bench.h"
+
+/* Standard headers */
+#include <stdio.h>
+
+/* ESP-IDF headers */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_cpu.h"
+#include "esp_system.h"
+
+/* Application module headers */
+#include "consumer.h"
+#include "pipeline.h"
+
+#define BENCH_PRIORITY      6   // Above the pipeline tasks so they don't skew the timings
+#define BENCH_QUEUE_LENGTH  VALUE_QUEUE_LEN  // Same as the GATT sink stage's input queue
+
+/* Results of the benchmarks run on one core */
+struct bench_core_run {
+    TaskHandle_t caller;
+    struct bench_result results[BENCH_MAX_STAGES];
+    int count;
+};
+
+static uint32_t bench_cycles(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+
+/* Inter-task transport: one batch pointer sent and received through a FreeRTOS
+ * queue, as between pipeline stages */
+static void bench_queue_transport(struct bench_result *result)
+{
+    struct bench_timer timer;
+    static struct pipeline_batch batch;
+    struct pipeline_batch *pointer = &batch;
+    QueueHandle_t queue = xQueueCreate(BENCH_QUEUE_LENGTH, sizeof(struct pipeline_batch *));
+    if (queue == NULL) {
+        bench_timer_init(&timer, bench_cycles);
+        bench_timer_result(&timer, "queue_transport", 0, result);
+        return;
+    }
+
+    bench_timer_init(&timer, bench_cycles);
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        uint32_t start = bench_cycles();
+        for (int j = 0; j < BENCH_BATCH; j++) {
+            batch.samples[0].value = (uint16_t)j;
+            xQueueSendToBack(queue, &pointer, 0);
+            xQueueReceive(queue, &pointer, 0);
+        }
+        uint32_t end = bench_cycles();
+        bench_timer_add(&timer, start, end);
+    }
+    bench_timer_result(&timer, "queue_transport", BENCH_QUEUE_LENGTH * sizeof(struct pipeline_batch *), result);
+    vQueueDelete(queue);
+}
+
+
+static void bench_task(void *pvParameters)
+{
+    struct bench_core_run *run = (struct bench_core_run *)pvParameters;
+
+    run->count = bench_run_portable_stages(bench_cycles, run->results);
+    bench_queue_transport(&run->results[run->count++]);
+
+    xTaskNotifyGive(run->caller);
+    vTaskDelete(NULL);
+}
+
+
+void bench_run(void)
+{
+    static struct bench_core_run runs[portNUM_PROCESSORS];
+
+    bench_print_csv_header();
+    /* One core at a time so the runs don't disturb each other */
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        runs[core].caller = xTaskGetCurrentTaskHandle();
+        xTaskCreatePinnedToCore(
+            bench_task,
+            "Bench",
+            4096,
+            &runs[core],
+            BENCH_PRIORITY,
+            NULL,
+            core
+        );
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bench_print_csv("esp32", core, "cycles", runs[core].results, runs[core].count);
+    }
+    printf("# free_heap=%"PRIu32"\n", esp_get_free_heap_size());
+}
@@ -0,0 +1,65 @@
+/* Benchmarks for the sample pipeline stages
+
+The portable stages (bench_stages.c) have no ESP-IDF dependencies and are built
+both into the firmware and into the host benchmark in bench/host. Each batch of
+operations is timed with a caller-supplied clock (CPU cycles on target, the time
+stamp counter or nanoseconds on the host) and reported per operation as CSV rows so runs can be compared with
+the baselines in bench/baselines using bench/compare.py.
+*/
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <inttypes.h>
+
+#define BENCH_ENABLED     0     // Set to 1 to run the benchmarks on both cores at boot
+#define BENCH_ITERATIONS  1000  // Timed batches per stage
+#define BENCH_BATCH       16    // Operations per timed batch, so clock overhead doesn't dominate
+#define BENCH_MAX_STAGES  8
+
+/* Timing statistics for one stage, in clock units per operation */
+struct bench_result {
+    const char *stage;
+    uint32_t iterations;   // Operations timed
+    uint32_t min;
+    uint32_t mean;
+    uint32_t max;
+    uint32_t jitter;       // Standard deviation
+    uint32_t state_bytes;  // Static memory used by the stage
+};
+
+/* Free running clock used to time each operation */
+typedef uint32_t (*bench_clock_fn)(void);
+
+/* Accumulates timings for one stage */
+struct bench_timer {
+    bench_clock_fn clock;
+    uint32_t overhead;  // Cost of reading the clock twice, subtracted from every sample
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sum_sq;
+};
+
+/* Prepare a timer, measuring the clock overhead */
+void bench_timer_init(struct bench_timer *timer, bench_clock_fn clock);
+
+/* Add the duration of one batch of BENCH_BATCH operations */
+void bench_timer_add(struct bench_timer *timer, uint32_t start, uint32_t end);
+
+/* Compute the statistics of a stage */
+void bench_timer_result(const struct bench_timer *timer, const char *stage, uint32_t state_bytes,
+                        struct bench_result *result);
+
+/* Run the portable stages. Returns the number of results written (at most BENCH_MAX_STAGES) */
+int bench_run_portable_stages(bench_clock_fn clock, struct bench_result *results);
+
+/* Print results as CSV rows: platform,core,stage,unit,iterations,min,mean,max,jitter,state_bytes */
+void bench_print_csv_header(void);
+void bench_print_csv(const char *platform, int core, const char *unit,
+                     const struct bench_result *results, int count);
+
+/* Run all stages on both cores and print the results (on target only) */
+void bench_run(void);
+
+#endif // BENCH_H
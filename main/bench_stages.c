@@ -0,0 +1,262 @@
+/* Portable stage benchmarks declared in bench.h */
+
+/* Header */
+#include "bench.h"
+
+/* Standard headers */
+#include <math.h>
+#include <stdio.h>
+
+/* Application module headers */
+#include "adc_lut.h"
+#include "filter.h"
+#include "producer.h"
+#include "seqlock.h"
+#include "snapshot.h"
+
+#define BENCH_WALK_CENTER 2048
+#define BENCH_WALK_STEP   16  // Largest change between synthetic ADC readings
+
+/* Synthetic ADC readings: a deterministic random walk over the 12-bit range */
+static uint32_t bench_walk_state;
+static uint32_t bench_walk_value;
+
+static void bench_walk_reset(void)
+{
+    bench_walk_state = 1;
+    bench_walk_value = BENCH_WALK_CENTER;
+}
+
+static uint32_t bench_walk_next(void)
+{
+    bench_walk_state = bench_walk_state * 1664525u + 1013904223u;
+    int32_t step = (int32_t)(bench_walk_state >> 24) % (2 * BENCH_WALK_STEP + 1) - BENCH_WALK_STEP;
+    int32_t value = (int32_t)bench_walk_value + step;
+    bench_walk_value = (value < 0) ? 0 : (value > 4095) ? 4095 : (uint32_t)value;
+    return bench_walk_value;
+}
+
+/* Keeps the compiler from discarding the benchmarked work */
+static volatile uint32_t bench_sink;
+
+
+void bench_timer_init(struct bench_timer *timer, bench_clock_fn clock)
+{
+    timer->clock = clock;
+    timer->overhead = UINT32_MAX;
+    for (int i = 0; i < 16; i++) {
+        uint32_t start = clock();
+        uint32_t end = clock();
+        if (end - start < timer->overhead) {
+            timer->overhead = end - start;
+        }
+    }
+    timer->count = 0;
+    timer->min = UINT32_MAX;
+    timer->max = 0;
+    timer->sum = 0;
+    timer->sum_sq = 0;
+}
+
+
+void bench_timer_add(struct bench_timer *timer, uint32_t start, uint32_t end)
+{
+    uint32_t elapsed = end - start;
+    elapsed = (elapsed > timer->overhead) ? elapsed - timer->overhead : 0;
+    timer->count++;
+    timer->sum += elapsed;
+    timer->sum_sq += (uint64_t)elapsed * elapsed;
+    if (elapsed < timer->min) {
+        timer->min = elapsed;
+    }
+    if (elapsed > timer->max) {
+        timer->max = elapsed;
+    }
+}
+
+
+void bench_timer_result(const struct bench_timer *timer, const char *stage, uint32_t state_bytes,
+                        struct bench_result *result)
+{
+    double mean = timer->count ? (double)timer->sum / timer->count : 0.0;
+    double variance = timer->count ? (double)timer->sum_sq / timer->count - mean * mean : 0.0;
+
+    /* Timings were taken per batch; report them per operation */
+    result->stage = stage;
+    result->iterations = timer->count * BENCH_BATCH;
+    result->min = timer->count ? (timer->min + BENCH_BATCH / 2) / BENCH_BATCH : 0;
+    result->mean = (uint32_t)(mean / BENCH_BATCH + 0.5);
+    result->max = (timer->max + BENCH_BATCH / 2) / BENCH_BATCH;
+    result->jitter = (uint32_t)(sqrt(variance > 0.0 ? variance : 0.0) / BENCH_BATCH + 0.5);
+    result->state_bytes = state_bytes;
+}
+
+
+/* Fill a batch of synthetic ADC readings */
+static void bench_walk_batch(uint32_t *values)
+{
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        values[i] = bench_walk_next();
+    }
+}
+
+
+/* Producer change detection against the tolerance */
+static void bench_change_detect(bench_clock_fn clock, struct bench_result *result)
+{
+    struct bench_timer timer;
+    uint32_t values[BENCH_BATCH];
+    uint32_t previous = BENCH_WALK_CENTER;
+
+    bench_walk_reset();
+    bench_timer_init(&timer, clock);
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_walk_batch(values);
+        uint32_t start = clock();
+        for (int j = 0; j < BENCH_BATCH; j++) {
+            if (adc_change_exceeds(previous, values[j], ADC_CHANGE_TOL)) {
+                previous = values[j];
+            }
+        }
+        uint32_t end = clock();
+        bench_timer_add(&timer, start, end);
+        bench_sink = previous;
+    }
+    bench_timer_result(&timer, "change_detect", 0, result);
+}
+
+
+/* Publishing a snapshot through a seqlock latch (same layout as snapshot.c) */
+static struct seqlock bench_lock;
+static struct potentiometer_snapshot bench_copies[2];
+
+static void bench_snapshot_publish(bench_clock_fn clock, struct bench_result *result)
+{
+    struct bench_timer timer;
+    uint32_t values[BENCH_BATCH];
+    struct potentiometer_snapshot snapshot = {0};
+
+    bench_walk_reset();
+    bench_timer_init(&timer, clock);
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_walk_batch(values);
+        uint32_t start = clock();
+        for (int j = 0; j < BENCH_BATCH; j++) {
+            snapshot.value = (uint16_t)values[j];
+            snapshot.seq++;
+            seqlock_write(&bench_lock, bench_copies, &snapshot, sizeof(snapshot));
+        }
+        uint32_t end = clock();
+        bench_timer_add(&timer, start, end);
+    }
+    bench_timer_result(&timer, "snapshot_publish", sizeof(bench_lock) + sizeof(bench_copies), result);
+}
+
+static void bench_snapshot_read(bench_clock_fn clock, struct bench_result *result)
+{
+    struct bench_timer timer;
+    struct potentiometer_snapshot snapshot;
+    uint32_t sum = 0;
+
+    bench_timer_init(&timer, clock);
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        uint32_t start = clock();
+        for (int j = 0; j < BENCH_BATCH; j++) {
+            seqlock_read(&bench_lock, bench_copies, &snapshot, sizeof(snapshot));
+            sum += snapshot.value;
+        }
+        uint32_t end = clock();
+        bench_timer_add(&timer, start, end);
+    }
+    bench_sink = sum;
+    bench_timer_result(&timer, "snapshot_read", sizeof(bench_lock) + sizeof(bench_copies), result);
+}
+
+
+/* Encoding the GATT characteristic payload */
+static void bench_payload_encode(bench_clock_fn clock, struct bench_result *result)
+{
+    struct bench_timer timer;
+    uint32_t values[BENCH_BATCH];
+    struct potentiometer_snapshot snapshot = {0};
+    uint8_t payload[POTENTIOMETER_PAYLOAD_LEN];
+    uint32_t sum = 0;
+
+    bench_walk_reset();
+    bench_timer_init(&timer, clock);
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_walk_batch(values);
+        uint32_t start = clock();
+        for (int j = 0; j < BENCH_BATCH; j++) {
+            snapshot.value = (uint16_t)values[j];
+            sum += (uint32_t)snapshot_encode(&snapshot, payload) + payload[0];
+        }
+        uint32_t end = clock();
+        bench_timer_add(&timer, start, end);
+    }
+    bench_sink = sum;
+    bench_timer_result(&timer, "payload_encode", sizeof(payload), result);
+}
+
+
+/* Converting ADC codes to millivolts and position through the calibration table */
+static struct adc_lut bench_lut;
+
+/* Stand-in for the eFuse calibration curve, roughly an ESP32 at 12 dB attenuation */
+static int bench_reference_curve(int raw, void *context)
+{
+    (void)context;
+    return 142 + raw * 3034 / (ADC_LUT_SIZE - 1);
+}
+
+static void bench_calibrate(bench_clock_fn clock, struct bench_result *result)
+{
+    struct bench_timer timer;
+    uint32_t values[BENCH_BATCH];
+    uint32_t sum = 0;
+
+    adc_lut_build(&bench_lut, bench_reference_curve, NULL);
+    bench_walk_reset();
+    bench_timer_init(&timer, clock);
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_walk_batch(values);
+        uint32_t start = clock();
+        for (int j = 0; j < BENCH_BATCH; j++) {
+            sum += adc_lut_millivolts(&bench_lut, values[j]) + adc_lut_percent(&bench_lut, values[j]);
+        }
+        uint32_t end = clock();
+        bench_timer_add(&timer, start, end);
+    }
+    bench_sink = sum;
+    bench_timer_result(&timer, "calibrate", sizeof(bench_lut), result);
+}
+
+
+int bench_run_portable_stages(bench_clock_fn clock, struct bench_result *results)
+{
+    int count = 0;
+    bench_change_detect(clock, &results[count++]);
+    bench_snapshot_publish(clock, &results[count++]);
+    bench_snapshot_read(clock, &results[count++]);
+    bench_payload_encode(clock, &results[count++]);
+    bench_calibrate(clock, &results[count++]);
+    return count;
+}
+
+
+void bench_print_csv_header(void)
+{
+    printf("platform,core,stage,unit,iterations,min,mean,max,jitter,state_bytes\n");
+}
+
+
+void bench_print_csv(const char *platform, int core, const char *unit,
+                     const struct bench_result *results, int count)
+{
+    for (int i = 0; i < count; i++) {
+        const struct bench_result *r = &results[i];
+        printf("%s,%d,%s,%s,%"PRIu32",%"PRIu32",%"PRIu32",%"PRIu32",%"PRIu32",%"PRIu32"\n",
+            platform, core, r->stage, unit, r->iterations, r->min, r->mean, r->max, r->jitter,
+            r->state_bytes);
+    }
+}
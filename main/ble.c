@@ -4,12 +4,24 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 #include "ble.h"
+
+#if BLE_STATS_PERIOD_MS > 0
+/* Compile ESP_LOGI in for this file so the load report can be enabled on its
+ * own (see ble_stats_task); its other Info lines stay filtered at run time */
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#endif
+
 /* Includes */
 #include "common.h"
 #include "gap.h"
+#include "esp_timer.h"
 #include "gatt_svc.h"
+#include "gateway.h"
+#include "notify.h"
 
 
+#define BLE_LOAD_LOG_NAME "BLE_LOAD"
+
 /* Library function declarations */
 void ble_store_config_init(void);
 
@@ -19,6 +31,10 @@ static void on_stack_sync(void);
 static void nimble_host_config_init(void);
 static void nimble_host_task(void *param);
 
+/* Private variables */
+static TaskHandle_t nimble_host_task_handle;
+static TaskHandle_t notify_task_handle;
+
 /* Private functions */
 /*
  *  Stack event callback functions
@@ -27,12 +43,24 @@ static void nimble_host_task(void *param);
  */
 static void on_stack_reset(int reason) {
     /* On reset, print reset reason to console */
-    ESP_LOGI(TAG, "nimble stack reset, reset reason: %d", reason);
+    ESP_LOGW(TAG, "nimble stack reset, reset reason: %d", reason);
+
+    /* Drop the GATT session state and pause notifications; the pipeline keeps
+     * running and the samples are replayed once centrals subscribe again */
+    notify_stack_reset(reason);
+    gap_reset();
+    gateway_reset();
 }
 
 static void on_stack_sync(void) {
+    /* Resume notifications for new subscriptions */
+    notify_stack_synced();
+
     /* On stack sync, do advertising initialization */
     adv_init();
+
+    /* Look for peer nodes if this device is a gateway */
+    gateway_start();
 }
 
 static void nimble_host_config_init(void) {
@@ -42,6 +70,14 @@ static void nimble_host_config_init(void) {
     ble_hs_cfg.gatts_register_cb = gatt_svr_register_cb;
     ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
 
+    /* Security manager: Just Works pairing with bonding, so a central can
+     * encrypt the link to write the configuration (see app_config.h) */
+    ble_hs_cfg.sm_io_cap = BLE_HS_IO_NO_INPUT_OUTPUT;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+
     /* Store host configuration */
     ble_store_config_init();
 }
@@ -64,11 +100,13 @@ static void potentiometer_notify_task(void *) {
 
     /* Loop forever */
     while (true) {
-        /* Send potentiometer indication if enabled by client via CCCD */
-        send_potentiometer_notification();
+        /* Send potentiometer notifications to every client that enabled them via CCCD,
+        as fast as each link can sustain */
+        TickType_t delay = pdMS_TO_TICKS(notify_service());
 
-        /* Sleep */
-        vTaskDelay(pdMS_TO_TICKS(BLE_NOTIFICATION_PERIOD_MS));
+        /* Sleep until the next notification is due or a new sample is published,
+        at least a tick so a full in-flight window doesn't spin the task */
+        ulTaskNotifyTake(pdTRUE, delay > 0 ? delay : 1);
     }
 
     /* Clean up at exit */
@@ -76,26 +114,100 @@ static void potentiometer_notify_task(void *) {
 }
 
 
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+/* Share of one core (in tenths of a percent) a task used over elapsed_us */
+static uint32_t task_load_permille(TaskHandle_t task, uint32_t *prev_runtime,
+                                   uint32_t elapsed_us) {
+    uint32_t runtime = ulTaskGetRunTimeCounter(task);
+    uint32_t used = runtime - *prev_runtime;
+    *prev_runtime = runtime;
+    return elapsed_us ? (uint32_t)((uint64_t)used * 1000 / elapsed_us) : 0;
+}
+#endif
+
+
+#if BLE_FAULT_INJECT_RESET_MS > 0
+/* Fault injection: force host resets to exercise the recovery path. The time
+ * from each reset to the first notification after it is traced and reported
+ * in the load statistics */
+static void ble_fault_inject_task(void *param) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(BLE_FAULT_INJECT_RESET_MS));
+        ESP_LOGW(TAG, "fault injection: forcing nimble host reset");
+        ble_hs_sched_reset(BLE_HS_ECONTROLLER);
+    }
+}
+#endif
+
+
+/* Periodically report connection load, notification delivery and BLE task CPU use */
+static void ble_stats_task(void *param) {
+    /* Local variables */
+    struct notify_stats stats;
+    uint32_t host_permille = 0;
+    uint32_t notify_permille = 0;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    int64_t prev_us = esp_timer_get_time();
+    uint32_t host_runtime = 0;
+    uint32_t notify_runtime = 0;
+#endif
+
+    /* Printed whatever the default log level */
+    esp_log_level_set(BLE_LOAD_LOG_NAME, ESP_LOG_INFO);
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(BLE_STATS_PERIOD_MS));
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        int64_t now_us = esp_timer_get_time();
+        uint32_t elapsed_us = (uint32_t)(now_us - prev_us);
+        prev_us = now_us;
+        host_permille = task_load_permille(nimble_host_task_handle,
+                                           &host_runtime, elapsed_us);
+        notify_permille = task_load_permille(notify_task_handle,
+                                             &notify_runtime, elapsed_us);
+#endif
+
+        notify_get_stats(&stats);
+        ESP_LOGI(BLE_LOAD_LOG_NAME,
+                 "load: conns=%d subscribers=%" PRIu32 " sent=%" PRIu32
+                 " completed=%" PRIu32 " failed=%" PRIu32 " dropped=%" PRIu32
+                 " retries=%" PRIu32 " depth=%" PRIu32 "/%" PRIu32
+                 " latency_us min/avg/max=%" PRIu32 "/%" PRIu32 "/%" PRIu32
+                 " host_cpu=%" PRIu32 ".%" PRIu32 "%% notify_cpu=%" PRIu32
+                 ".%" PRIu32 "%% resets=%" PRIu32 " replayed=%" PRIu32
+                 " recovery_ms last/max=%" PRIu32 "/%" PRIu32,
+                 gap_connection_count(), stats.subscribers, stats.sent,
+                 stats.completed, stats.failed, stats.drops, stats.retries,
+                 stats.queue_depth, stats.max_queue_depth,
+                 stats.latency_min_us,
+                 stats.latency_count
+                     ? (uint32_t)(stats.latency_total_us / stats.latency_count)
+                     : 0,
+                 stats.latency_max_us, host_permille / 10, host_permille % 10,
+                 notify_permille / 10, notify_permille % 10, stats.resets,
+                 stats.replayed, stats.recovery_last_us / 1000,
+                 stats.recovery_max_us / 1000);
+    }
+}
+
+
+void ble_sample_published(void) {
+    /* Subscriptions waiting for the value to move past their deadband */
+    if (notify_task_handle != NULL) {
+        xTaskNotifyGive(notify_task_handle);
+    }
+}
+
+
 /* Function that initializes BLE task. Adapted from app_main in the example */
 void ble_init() {
     /* Local variables */
     int rc;
     esp_err_t ret;
 
-    /*
-     * NVS flash initialization
-     * Dependency of BLE stack to store configurations between resets
-     */
-    ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
-        ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "failed to initialize nvs flash, error code: %d ", ret);
-        return;
-    }
+    /* NVS flash, which the BLE stack uses to store configurations between
+     * resets, is initialized in app_main before the runtime configuration */
 
     /* NimBLE stack initialization 
     
@@ -128,7 +240,14 @@ void ble_init() {
     nimble_host_config_init();
 
     /* Start NimBLE host task thread and return */
-    xTaskCreate(nimble_host_task, "NimBLE Host", 4*1024, NULL, 5, NULL);
-    xTaskCreate(potentiometer_notify_task, "Potentiometer", 4*1024, NULL, 5, NULL);
+    xTaskCreate(nimble_host_task, "NimBLE Host", 4*1024, NULL, 5, &nimble_host_task_handle);
+    xTaskCreate(potentiometer_notify_task, "Potentiometer", 4*1024, NULL, 5, &notify_task_handle);
+    gateway_init();
+    if (BLE_STATS_PERIOD_MS > 0) {
+        xTaskCreate(ble_stats_task, "BLE Stats", 3*1024, NULL, 1, NULL);
+    }
+#if BLE_FAULT_INJECT_RESET_MS > 0
+    xTaskCreate(ble_fault_inject_task, "BLE Fault", 2*1024, NULL, 1, NULL);
+#endif
     return;
 }
\ No newline at end of file
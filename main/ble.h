@@ -1,9 +1,14 @@
 #ifndef BLE_H
 #define BLE_H
 
-#define BLE_NOTIFICATION_PERIOD_MS 500 // 500ms (2Hz). Slow because BLE is slow
+#define BLE_NOTIFICATION_PERIOD_MS 500 // 500ms (2Hz). Slow because BLE is slow. Default, see app_config.h
+#define BLE_STATS_PERIOD_MS 10000 // Period of the load statistics report, 0 to disable
+#define BLE_FAULT_INJECT_RESET_MS 0 // Force a NimBLE host reset this often to exercise recovery, 0 to disable
 
 /* Initialize the BLE system, including the task that sends notifications to connected devices */
 void ble_init(void);
 
+/* Wake the notification task after the consumer published a new sample */
+void ble_sample_published(void);
+
 #endif // BLE_H
\ No newline at end of file
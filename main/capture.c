@@ -0,0 +1,166 @@
+/* Implementations for capture.h */
+
+/* Header */
+#include "capture.h"
+
+/* Standard headers */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* ESP-IDF headers */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+/* Application module headers */
+#include "capture_file.h"
+#include "pipeline.h"
+
+#define CAPTURE_LOG_NAME    "CAPTURE"
+#define CAPTURE_LINE_BYTES  32  // Encoded bytes per console line
+
+#if CAPTURE_ENABLED
+
+/* Encoded bytes waiting to be printed. The producer appends, the capture task
+ * takes everything at once */
+static uint8_t capture_buffer[CAPTURE_BUFFER_LEN];
+static size_t capture_len;
+static struct capture_codec capture_codec;
+static uint32_t capture_dropped;
+static bool capture_running;
+static portMUX_TYPE capture_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void capture_sample(int64_t timestamp_us, uint16_t value)
+{
+    struct capture_record record = {
+        .timestamp_us = timestamp_us,
+        .value = value,
+    };
+    uint8_t encoded[CAPTURE_RECORD_MAX_LEN];
+
+    portENTER_CRITICAL(&capture_lock);
+    if (capture_running) {
+        /* Encode against a copy, so a dropped record leaves the delta chain intact */
+        struct capture_codec codec = capture_codec;
+        size_t len = capture_encode(&codec, &record, encoded);
+        if (capture_len + len <= CAPTURE_BUFFER_LEN) {
+            memcpy(&capture_buffer[capture_len], encoded, len);
+            capture_len += len;
+            capture_codec = codec;
+        } else {
+            capture_dropped++;
+        }
+    }
+    portEXIT_CRITICAL(&capture_lock);
+}
+
+
+/* Print data as hex lines, each numbered and ending in the CRC-32 of its bytes
+ * so a line garbled or lost on the console is caught rather than corrupting the
+ * rest of the delta-encoded stream. Each line goes out in a single write, so
+ * output from other tasks can't land in the middle of it */
+static void print_hex(uint32_t *line_number, const uint8_t *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    char line[sizeof("CAPTURE,4294967295,,ffffffff\n") + 2 * CAPTURE_LINE_BYTES];
+
+    for (size_t start = 0; start < len; start += CAPTURE_LINE_BYTES) {
+        size_t count = (len - start < CAPTURE_LINE_BYTES) ? len - start : CAPTURE_LINE_BYTES;
+        int pos = snprintf(line, sizeof(line), "CAPTURE,%" PRIu32 ",", (*line_number)++);
+        for (size_t i = 0; i < count; i++) {
+            line[pos++] = digits[data[start + i] >> 4];
+            line[pos++] = digits[data[start + i] & 0x0F];
+        }
+        pos += snprintf(&line[pos], sizeof(line) - pos, ",%08" PRIx32 "\n",
+                        capture_crc32(&data[start], count));
+        fwrite(line, 1, pos, stdout);
+    }
+}
+
+
+/* Print the buffered bytes every CAPTURE_FLUSH_MS */
+static void capture_task(void *pvParameters)
+{
+    static uint8_t pending[CAPTURE_BUFFER_LEN];
+    uint8_t header[CAPTURE_HEADER_LEN];
+    uint32_t reported_dropped = 0;
+    uint32_t line_number = 0;
+    TickType_t start = xTaskGetTickCount();
+
+    printf("CAPTURE,BEGIN\n");
+    print_hex(&line_number, header, capture_encode_header(header));
+    portENTER_CRITICAL(&capture_lock);
+    capture_codec_reset(&capture_codec);
+    capture_running = true;
+    portEXIT_CRITICAL(&capture_lock);
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(CAPTURE_FLUSH_MS));
+        bool done = CAPTURE_DURATION_MS > 0 &&
+                    xTaskGetTickCount() - start >= pdMS_TO_TICKS(CAPTURE_DURATION_MS);
+
+        portENTER_CRITICAL(&capture_lock);
+        size_t len = capture_len;
+        memcpy(pending, capture_buffer, len);
+        capture_len = 0;
+        uint32_t dropped = capture_dropped;
+        if (done) {
+            capture_running = false;
+        }
+        portEXIT_CRITICAL(&capture_lock);
+
+        print_hex(&line_number, pending, len);
+        if (dropped != reported_dropped) {
+            ESP_LOGW(CAPTURE_LOG_NAME, "%" PRIu32 " samples dropped, buffer full", dropped);
+            reported_dropped = dropped;
+        }
+        if (done) {
+            printf("CAPTURE,END\n");
+            vTaskDelete(NULL);
+        }
+    }
+}
+
+
+void capture_init(void)
+{
+    xTaskCreatePinnedToCore(
+        capture_task,
+        "Capture",
+        3072,
+        NULL,
+        1,
+        NULL,
+        0
+    );
+}
+
+#else  // CAPTURE_ENABLED
+
+void capture_sample(int64_t timestamp_us, uint16_t value)
+{
+    (void)timestamp_us;
+    (void)value;
+}
+
+void capture_init(void)
+{
+}
+
+#endif  // CAPTURE_ENABLED
+
+
+static void capture_sink_process(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    for (int i = 0; i < batch->count; i++) {
+        capture_sample(batch->samples[i].timestamp_us, batch->samples[i].value);
+    }
+}
+
+
+struct pipeline_stage capture_sink_stage = {
+    .name = "capture",
+    .process = capture_sink_process,
+};
@@ -0,0 +1,43 @@
+/* ADC capture mode
+
+When CAPTURE_ENABLED is set, the capture sink stage is fed every new ULP sample
+(timestamp and ADC code), including samples the change tolerance filters out,
+and records it in the format of capture_file.h. The encoded bytes are buffered in RAM and streamed
+to the serial console as hex lines, numbered from 0 and each ending in the
+CRC-32 of its bytes:
+
+    CAPTURE,BEGIN
+    CAPTURE,0,4144435401000000,ccb23adc   (file header first, then records)
+    CAPTURE,1,...
+    CAPTURE,END                           (once CAPTURE_DURATION_MS has passed)
+
+The records are delta encoded, so a single garbled or missing line spoils the
+rest of the capture; bench/capture.py rejects the log rather than skip it.
+
+bench/capture.py turns a console log into a capture file, which
+bench/host/replay_host runs through the pipeline faster than real time.
+*/
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <inttypes.h>
+
+#define CAPTURE_ENABLED       0       // Set to 1 to stream ULP samples to the console
+#define CAPTURE_BUFFER_LEN    2048    // Encoded bytes buffered between flushes
+#define CAPTURE_FLUSH_MS      250     // How often the buffer is printed
+#define CAPTURE_DURATION_MS   600000  // Length of the capture, 0 to capture until reset
+
+struct pipeline_stage;
+
+/* Sink stage that records every sample with capture_sample. It leaves the batch
+ * as it is, so it can sit in front of a filter */
+extern struct pipeline_stage capture_sink_stage;
+
+/* Record a sample seen by the producer. Never blocks; if the buffer is full the
+ * sample is dropped and counted */
+void capture_sample(int64_t timestamp_us, uint16_t value);
+
+/* Start the task that streams the capture. Does nothing unless CAPTURE_ENABLED */
+void capture_init(void);
+
+#endif // CAPTURE_H
@@ -0,0 +1,120 @@
+/* Implementations for capture_file.h */
+
+/* Header */
+#include "capture_file.h"
+
+/* Standard headers */
+#include <string.h>
+
+
+static size_t put_uleb128(uint32_t value, uint8_t *out)
+{
+    size_t len = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[len++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return len;
+}
+
+
+/* Returns the number of bytes read, or 0 if in ends early or the value doesn't fit */
+static size_t get_uleb128(const uint8_t *in, size_t len, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        result |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+
+uint32_t capture_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+
+size_t capture_encode_header(uint8_t *out)
+{
+    memcpy(out, CAPTURE_MAGIC, 4);
+    out[4] = CAPTURE_VERSION;
+    out[5] = 0;
+    out[6] = 0;
+    out[7] = 0;
+    return CAPTURE_HEADER_LEN;
+}
+
+
+bool capture_decode_header(const uint8_t *in, size_t len)
+{
+    return len >= CAPTURE_HEADER_LEN && memcmp(in, CAPTURE_MAGIC, 4) == 0 &&
+           in[4] == CAPTURE_VERSION;
+}
+
+
+void capture_codec_reset(struct capture_codec *codec)
+{
+    codec->timestamp_us = 0;
+    codec->value = 0;
+}
+
+
+size_t capture_encode(struct capture_codec *codec, const struct capture_record *record,
+                      uint8_t *out)
+{
+    int64_t delta_us = record->timestamp_us - codec->timestamp_us;
+    if (delta_us < 0) {
+        delta_us = 0;
+    } else if (delta_us > UINT32_MAX) {
+        delta_us = UINT32_MAX;
+    }
+    int32_t delta_value = (int32_t)record->value - (int32_t)codec->value;
+    uint32_t zigzag = ((uint32_t)delta_value << 1) ^ (uint32_t)(delta_value >> 31);
+
+    size_t len = put_uleb128((uint32_t)delta_us, out);
+    len += put_uleb128(zigzag, out + len);
+
+    codec->timestamp_us += delta_us;
+    codec->value = record->value;
+    return len;
+}
+
+
+size_t capture_decode(struct capture_codec *codec, const uint8_t *in, size_t len,
+                      struct capture_record *record)
+{
+    uint32_t delta_us;
+    uint32_t zigzag;
+
+    size_t used = get_uleb128(in, len, &delta_us);
+    if (used == 0) {
+        return 0;
+    }
+    size_t value_len = get_uleb128(in + used, len - used, &zigzag);
+    if (value_len == 0) {
+        return 0;
+    }
+    int32_t value = (int32_t)codec->value + (int32_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+    if (value < 0 || value > UINT16_MAX) {
+        return 0;
+    }
+
+    codec->timestamp_us += delta_us;
+    codec->value = (uint16_t)value;
+    record->timestamp_us = codec->timestamp_us;
+    record->value = codec->value;
+    return used + value_len;
+}
@@ -0,0 +1,62 @@
+/* ADC capture file format
+
+A capture file holds the ULP samples the producer saw, in order, so a recorded
+dial movement can be replayed through the pipeline on the host (bench/host).
+It is a CAPTURE_HEADER_LEN byte header followed by one variable-length record
+per sample:
+
+    header:  "ADCT", uint8 version, uint8 flags (0), uint16 reserved (0)
+    record:  LEB128 unsigned  microseconds since the previous record (or since boot)
+             LEB128 zigzag    change of the ADC code since the previous record
+
+At the ULP's fastest rate a record typically takes four bytes.
+
+These functions have no ESP-IDF dependencies so they also build on the host.
+*/
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#define CAPTURE_MAGIC          "ADCT"
+#define CAPTURE_VERSION        1
+#define CAPTURE_HEADER_LEN     8
+#define CAPTURE_RECORD_MAX_LEN 8  // 5 byte time delta + 3 byte value delta
+
+/* One sample as seen by the producer */
+struct capture_record {
+    int64_t timestamp_us;  // esp_timer time at which the ULP took the sample
+    uint16_t value;        // Averaged ADC code from the ULP
+};
+
+/* Running state of an encoder or decoder: the previous record */
+struct capture_codec {
+    int64_t timestamp_us;
+    uint16_t value;
+};
+
+/* CRC-32 of data, as computed by zlib, used to check the capture's console lines */
+uint32_t capture_crc32(const uint8_t *data, size_t len);
+
+/* Write the file header into out, which must hold CAPTURE_HEADER_LEN bytes */
+size_t capture_encode_header(uint8_t *out);
+
+/* True if in starts with a header this version can read */
+bool capture_decode_header(const uint8_t *in, size_t len);
+
+/* Start a new file (both encoding and decoding) */
+void capture_codec_reset(struct capture_codec *codec);
+
+/* Encode record into out, which must hold CAPTURE_RECORD_MAX_LEN bytes, and
+ * advance codec. Returns the number of bytes written. Records must be in time order */
+size_t capture_encode(struct capture_codec *codec, const struct capture_record *record,
+                      uint8_t *out);
+
+/* Decode the next record from in and advance codec. Returns the number of bytes
+ * read, or 0 if in holds no complete, valid record */
+size_t capture_decode(struct capture_codec *codec, const uint8_t *in, size_t len,
+                      struct capture_record *record);
+
+#endif // CAPTURE_FILE_H
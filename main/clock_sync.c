@@ -0,0 +1,224 @@
+/* Implementations for clock_sync.h */
+
+/* Header */
+#include "clock_sync.h"
+
+/* Compile ESP_LOGI in for this file so the sync messages and statistics are
+ * printed even at the default Warning level (see clock_sync_init) */
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+
+/* Includes */
+#include "common.h"
+#include "esp_private/esp_clk.h"
+#include "gatt_svc.h"
+#include "seqlock.h"
+#include "soc/rtc.h"
+
+#define CLOCK_SYNC_LOG_NAME "CLOCK_SYNC"
+#define RTC_CAL_FRACT_BITS  19  // esp_clk_slowclk_cal_get() is the tick period in Q13.19 us
+
+/* Model and statistics, as published to other tasks */
+struct clock_sync_state {
+    struct sync_model model;
+    struct sync_stats stats;
+};
+
+/* Round trip waiting for the central to report when the reply arrived */
+struct clock_sync_pending {
+    bool active;
+    int64_t send_us;
+    uint32_t receive_ticks;
+    uint32_t reply_ticks;
+};
+
+/* Private variables */
+/* The estimator and the round trip in progress are only touched by the NimBLE host task */
+static struct sync_estimator clock_sync_estimator;
+static struct clock_sync_pending clock_sync_pending;
+static uint16_t clock_sync_conn = BLE_HS_CONN_HANDLE_NONE;  // Connection driving the model
+/* Calibrated RTC tick period in Q13.19 us, set once at init. Kept in fixed
+ * point so the producer converts every sample with integer math only */
+static uint32_t clock_sync_tick_period;
+/* Readers on any task get the model through a latch written by the host task */
+static struct seqlock clock_sync_lock;
+static struct clock_sync_state clock_sync_copies[2];
+
+
+/* Private functions */
+static void publish(void)
+{
+    struct clock_sync_state state = {
+        .model = clock_sync_estimator.model,
+        .stats = clock_sync_estimator.stats,
+    };
+    seqlock_write(&clock_sync_lock, clock_sync_copies, &state, sizeof(state));
+}
+
+
+static void read_state(struct clock_sync_state *state)
+{
+    seqlock_read(&clock_sync_lock, clock_sync_copies, state, sizeof(*state));
+}
+
+
+static void log_stats(const struct sync_stats *stats)
+{
+    ESP_LOGI(CLOCK_SYNC_LOG_NAME,
+             "exchanges=%" PRIu32 " rejected=%" PRIu32 " fitted=%" PRIu32
+             " delay=%" PRIu32 "us (min %" PRIu32 ") error=%" PRId32 "us rms=%" PRIu32
+             "us max=%" PRIu32 "us bound=%" PRIu32 "us drift=%" PRId32 "ppb",
+             stats->exchanges, stats->rejected, stats->fitted, stats->last_delay_us,
+             stats->min_delay_us, stats->last_error_us, stats->rms_error_us,
+             stats->max_error_us, stats->error_bound_us, stats->drift_ppb);
+}
+
+
+/* Bound the round trips by the connection's event interval, which may have
+ * been updated since the last request */
+static void set_interval(uint16_t conn_handle)
+{
+    struct ble_gap_conn_desc desc;
+
+    if (ble_gap_conn_find(conn_handle, &desc) == 0) {
+        /* conn_itvl is in 1.25ms units, and the device may skip conn_latency events */
+        uint32_t interval_us = desc.conn_itvl * 1250u * (desc.conn_latency + 1u);
+        sync_estimator_set_interval(&clock_sync_estimator, interval_us);
+    }
+}
+
+
+/* Finish a round trip with the time its reply reached the central */
+static void complete(const struct clock_sync_pending *pending, const struct clock_sync_request *request)
+{
+    if (!pending->active || request->prev_return_us == 0) {
+        return;
+    }
+    struct sync_exchange exchange = {
+        .send_us = pending->send_us,
+        .return_us = request->prev_return_us,
+        .receive_ticks = pending->receive_ticks,
+        .reply_ticks = pending->reply_ticks,
+    };
+    bool was_valid = clock_sync_estimator.model.valid;
+    if (!sync_estimator_add(&clock_sync_estimator, &exchange)) {
+        ESP_LOGD(CLOCK_SYNC_LOG_NAME, "rejected round trip sent at %" PRId64, pending->send_us);
+    }
+    publish();
+
+    const struct sync_stats *stats = &clock_sync_estimator.stats;
+    if (!was_valid && clock_sync_estimator.model.valid) {
+        ESP_LOGI(CLOCK_SYNC_LOG_NAME, "synced; conn_handle=%d bound=%" PRIu32 "us",
+                 clock_sync_conn, stats->error_bound_us);
+    } else if (CLOCK_SYNC_LOG_EVERY > 0 && stats->exchanges % CLOCK_SYNC_LOG_EVERY == 0) {
+        log_stats(stats);
+    }
+}
+
+
+/* Public functions */
+void clock_sync_init(void)
+{
+    esp_log_level_set(CLOCK_SYNC_LOG_NAME, ESP_LOG_INFO);
+    clock_sync_tick_period = esp_clk_slowclk_cal_get();
+    sync_estimator_reset(&clock_sync_estimator, (double)clock_sync_tick_period / (1 << RTC_CAL_FRACT_BITS));
+    publish();
+}
+
+
+uint32_t clock_sync_ticks(void)
+{
+    return (uint32_t)rtc_time_get();
+}
+
+
+int64_t clock_sync_ticks_to_us(uint32_t ticks)
+{
+    /* A 32-bit tick count times a 32-bit period fits in 64 bits */
+    return (int64_t)(((uint64_t)ticks * clock_sync_tick_period) >> RTC_CAL_FRACT_BITS);
+}
+
+
+uint32_t clock_sync_us_to_ticks(uint32_t us)
+{
+    return (uint32_t)(((uint64_t)us << RTC_CAL_FRACT_BITS) / clock_sync_tick_period);
+}
+
+
+int clock_sync_request(uint16_t conn_handle, const struct clock_sync_request *request)
+{
+    uint32_t receive_ticks = clock_sync_ticks();
+    int rc;
+
+    if (conn_handle != clock_sync_conn) {
+        ESP_LOGI(CLOCK_SYNC_LOG_NAME, "syncing to conn_handle=%d", conn_handle);
+        clock_sync_conn = conn_handle;
+        clock_sync_pending.active = false;
+    }
+
+    /* Reply first so the model update doesn't add to the round trip */
+    struct clock_sync_pending previous = clock_sync_pending;
+    struct clock_sync_reply reply = {
+        .send_us = request->send_us,
+        .receive_ticks = receive_ticks,
+        .reply_ticks = clock_sync_ticks(),
+    };
+    rc = send_clock_sync_reply(conn_handle, &reply);
+    clock_sync_pending = (struct clock_sync_pending){
+        .active = rc == 0,
+        .send_us = request->send_us,
+        .receive_ticks = reply.receive_ticks,
+        .reply_ticks = reply.reply_ticks,
+    };
+    set_interval(conn_handle);
+    complete(&previous, request);
+    return rc;
+}
+
+
+bool clock_sync_map(uint32_t ticks, int64_t *time_us, uint32_t *error_us)
+{
+    struct clock_sync_state state;
+    read_state(&state);
+    return sync_model_map(&state.model, ticks, time_us, error_us);
+}
+
+
+size_t clock_sync_encode_value(const struct potentiometer_snapshot *snapshot, uint8_t *payload)
+{
+    struct clock_sync_value value = {
+        .value = snapshot->value,
+        .flags = snapshot->flags,
+    };
+    clock_sync_map(snapshot->rtc_ticks, &value.time_us, &value.error_us);
+    memcpy(payload, &value, sizeof(value));
+    return sizeof(value);
+}
+
+
+void clock_sync_get_status(struct clock_sync_status *status)
+{
+    struct clock_sync_state state;
+    read_state(&state);
+
+    *status = (struct clock_sync_status){
+        .drift_ppb = state.stats.drift_ppb,
+        .exchanges = state.stats.exchanges,
+        .rejected = state.stats.rejected,
+        .last_delay_us = state.stats.last_delay_us,
+        .min_delay_us = state.stats.min_delay_us,
+        .last_error_us = state.stats.last_error_us,
+        .max_error_us = state.stats.max_error_us,
+        .rms_error_us = state.stats.rms_error_us,
+        .fitted = state.stats.fitted,
+    };
+    sync_model_map(&state.model, clock_sync_ticks(), &status->time_us, &status->error_us);
+}
+
+
+void clock_sync_disconnect(uint16_t conn_handle)
+{
+    if (conn_handle == clock_sync_conn) {
+        clock_sync_conn = BLE_HS_CONN_HANDLE_NONE;
+        clock_sync_pending.active = false;
+    }
+}
@@ -0,0 +1,112 @@
+/* Time sync service
+
+Lets a central line up this device's samples with its own clock, and so with
+the samples of every other unit synced to the same central.
+
+The central writes a struct clock_sync_request to the exchange characteristic
+(0xFFC1 in service 0xFFC0), about once a second, and the device answers every
+write with a notification of struct clock_sync_reply on the same
+characteristic, stamped with the RTC slow clock timer. Each request also
+carries the time the previous reply arrived, which completes that round trip;
+the device then refits its model of central time against RTC ticks (see
+sync_estimator.h). One connection drives the model at a time; when another one
+sends a request it takes over, and the model starts over if the new central's
+clock disagrees with it.
+
+The ULP stamps every measurement with the low 32 bits of the RTC timer (on the
+ESP32; on other targets the producer stamps a sample half a ULP period before
+its poll), so a sample only
+carries a compact relative timestamp. It is mapped to central time when it is
+read or notified through the timestamped value characteristic (0xFFC3, struct
+clock_sync_value), together with a bound on the error of the mapping. The sync
+error statistics can be read from the status characteristic (0xFFC2, struct
+clock_sync_status) and are logged every CLOCK_SYNC_LOG_EVERY exchanges, under
+the CLOCK_SYNC tag, which is enabled at Info whatever the default log level.
+
+All characteristic values are sent over BLE as is (little-endian, laid out
+without padding).
+*/
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "snapshot.h"
+#include "sync_estimator.h"
+
+#define CLOCK_SYNC_LOG_EVERY  60  // Exchanges between statistics logs, 0 to disable
+
+/* Written by the central to start a round trip. Fits a 23 byte ATT MTU */
+struct clock_sync_request {
+    int64_t send_us;          // Central clock when this request was sent
+    int64_t prev_return_us;   // Central clock when the reply to the previous request arrived,
+                              // 0 if it didn't
+};
+
+/* Notified back for every request */
+struct clock_sync_reply {
+    int64_t send_us;          // The request's, so late replies can be told apart
+    uint32_t receive_ticks;   // RTC ticks when the request arrived
+    uint32_t reply_ticks;     // RTC ticks when this reply was sent
+};
+
+/* Latest sample on the central's clock */
+struct clock_sync_value {
+    int64_t time_us;          // Capture time on the central's clock, 0 if not synced
+    uint32_t error_us;        // Bound on the error of time_us, UINT32_MAX if not synced
+    uint16_t value;           // ADC code
+    uint16_t flags;           // POTENTIOMETER_FLAG_*
+};
+
+/* Sync state and error statistics */
+struct clock_sync_status {
+    int64_t time_us;          // Central clock now, by the model, 0 if not synced
+    uint32_t error_us;        // Bound on the error of time_us, UINT32_MAX if not synced
+    int32_t drift_ppb;        // RTC rate against its calibration
+    uint32_t exchanges;       // Round trips accepted
+    uint32_t rejected;        // Round trips that didn't make sense
+    uint32_t last_delay_us;   // Round trip minus the device's processing, last exchange
+    uint32_t min_delay_us;    // Best delay among the fitted exchanges
+    int32_t last_error_us;    // Central time minus the model's prediction, last exchange
+    uint32_t max_error_us;    // Largest |last_error_us| since the central started syncing
+    uint32_t rms_error_us;    // RMS of last_error_us since the central started syncing
+    uint32_t fitted;          // Exchanges the model is fitted to
+};
+
+_Static_assert(sizeof(struct clock_sync_request) == 16, "clock_sync_request must not be padded");
+_Static_assert(sizeof(struct clock_sync_reply) == 16, "clock_sync_reply must not be padded");
+_Static_assert(sizeof(struct clock_sync_value) == 16, "clock_sync_value must not be padded");
+_Static_assert(sizeof(struct clock_sync_status) == 48, "clock_sync_status must not be padded");
+
+/* Read the RTC calibration. Call once before the producer and the NimBLE host start */
+void clock_sync_init(void);
+
+/* Low 32 bits of the RTC timer, the timebase of the ULP's sample stamps */
+uint32_t clock_sync_ticks(void);
+
+/* Convert between a span of RTC ticks and microseconds at the calibrated tick
+ * period. For ages of samples, not for mapping to central time */
+int64_t clock_sync_ticks_to_us(uint32_t ticks);
+uint32_t clock_sync_us_to_ticks(uint32_t us);
+
+/* Handle a request written by a connection: send the reply and refit with the
+ * round trip it completes. Returns the ble_gatts_notify_custom return code */
+int clock_sync_request(uint16_t conn_handle, const struct clock_sync_request *request);
+
+/* Central time at RTC tick count ticks and a bound on its error. Returns false
+ * if not synced. Safe to call from any task */
+bool clock_sync_map(uint32_t ticks, int64_t *time_us, uint32_t *error_us);
+
+/* Encode the timestamped value of a snapshot into payload, which must hold
+ * sizeof(struct clock_sync_value) bytes. Returns the number of bytes written */
+size_t clock_sync_encode_value(const struct potentiometer_snapshot *snapshot, uint8_t *payload);
+
+/* Copy the sync state and statistics. Safe to call from any task */
+void clock_sync_get_status(struct clock_sync_status *status);
+
+/* A connection went away: drop its unfinished round trip. The model stays */
+void clock_sync_disconnect(uint16_t conn_handle);
+
+#endif // CLOCK_SYNC_H
@@ -2,40 +2,52 @@
 
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 
+#include "app_config.h"
 #include "ble.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "trace.h"
 
-static uint16_t potentiometer_value;
-
-void update_potentiometer_value(void *pQueue)
+/* Pause between draining the queue, so the stage runs at the configured cadence */
+static uint32_t gatt_sink_period_ms(struct pipeline_stage *stage)
 {
-    QueueHandle_t queue = (QueueHandle_t)pQueue;
-    while (true)
-    {
-        BaseType_t result = xQueueReceive(queue, &potentiometer_value, DEQUEUE_WAIT_MS);
-        if (result == pdPASS) {
-            ESP_LOGI("CONSUMER", "New potentiometer value sent to BLE: %"PRIu16"\n", potentiometer_value);
-        }
-        vTaskDelay(pdMS_TO_TICKS(DEQUEUE_WAIT_MS));
-    }
+    struct app_config config;
+    app_config_get(&config);
+    return config.dequeue_wait_ms;
 }
 
-uint16_t get_potentiometer_value(void)
+
+/* Publish every sample as the snapshot read by the GATT service */
+static void gatt_sink_process(struct pipeline_stage *stage, struct pipeline_batch *batch)
 {
-    return potentiometer_value;
+    for (int i = 0; i < batch->count; i++) {
+        snapshot_publish(&batch->samples[i]);
+    }
+    ble_sample_published();
 }
 
 
-void potentiometer_data_consumer_init(void *pQueue)
+/* Record every published sample in the trace log */
+static void log_sink_process(struct pipeline_stage *stage, struct pipeline_batch *batch)
 {
-    xTaskCreatePinnedToCore(
-        update_potentiometer_value,
-        "Consumer",
-        2048,
-        pQueue,
-        CONSUMER_PRIORITY,
-        NULL,
-        CONSUMER_CORE
-    );
+    for (int i = 0; i < batch->count; i++) {
+        trace_event(TRACE_EV_VALUE_CONSUMED, batch->samples[i].value, batch->samples[i].flags);
+    }
 }
+
+
+struct pipeline_stage gatt_sink_stage = {
+    .name = "gatt",
+    .process = gatt_sink_process,
+    .period_ms = gatt_sink_period_ms,
+    .queue_len = VALUE_QUEUE_LEN,
+    .core = CONSUMER_CORE,
+    .priority = CONSUMER_PRIORITY,
+    .stack_size = 2048,
+};
+
+struct pipeline_stage log_sink_stage = {
+    .name = "log",
+    .process = log_sink_process,
+};
@@ -3,17 +3,17 @@
 
 #include <inttypes.h>
 
-#define DEQUEUE_WAIT_MS 100  // 100ms (10Hz)
+#define DEQUEUE_WAIT_MS 100  // 100ms (10Hz), default for the runtime configuration (see app_config.h)
+#define VALUE_QUEUE_LEN 10   // Batches waiting for the GATT sink
 #define CONSUMER_CORE 0
 #define CONSUMER_PRIORITY 4
 
-/* Get a new value from the queue and set it as the value for the GATT characteristic */
-void update_potentiometer_value(void *pQueue);
+struct pipeline_stage;
 
-/* Public function to get the current value for the potentiometer (used by GATT service) */
-uint16_t get_potentiometer_value(void);
+/* Sink stage with its own task on CONSUMER_CORE: publishes each sample as the
+ * snapshot read by the GATT service (see snapshot.h) and wakes the notifier */
+extern struct pipeline_stage gatt_sink_stage;
+/* Sink stage: records each published sample in the trace log (see trace.h) */
+extern struct pipeline_stage log_sink_stage;
 
-/* Initialize consumer task */
-void potentiometer_data_consumer_init(void *pQueue);
-
-#endif  // CONSUMER_H
\ No newline at end of file
+#endif  // CONSUMER_H
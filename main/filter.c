@@ -0,0 +1,26 @@
+/* Implementations for filter.h */
+
+/* Header */
+#include "filter.h"
+
+
+bool adc_change_exceeds(uint32_t previous, uint32_t current, uint32_t tolerance)
+{
+    uint32_t adc_diff = (previous > current) ? (previous - current) : (current - previous);
+    return adc_diff > tolerance;
+}
+
+
+int adc_change_filter(struct potentiometer_sample *samples, int count, uint32_t *previous,
+                      uint32_t tolerance)
+{
+    int kept = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (adc_change_exceeds(*previous, samples[i].value, tolerance)) {
+            *previous = samples[i].value;
+            samples[kept++] = samples[i];
+        }
+    }
+    return kept;
+}
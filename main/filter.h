@@ -0,0 +1,22 @@
+/* Sample filtering shared by the producer and the notifier
+
+These functions have no ESP-IDF dependencies so they also build on the host
+(see bench/host).
+*/
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "snapshot.h"
+
+/* True if current differs from previous by more than tolerance */
+bool adc_change_exceeds(uint32_t previous, uint32_t current, uint32_t tolerance);
+
+/* Keep, in place, the samples that differ by more than tolerance from the last
+ * one kept, starting from *previous. Updates *previous and returns the number kept */
+int adc_change_filter(struct potentiometer_sample *samples, int count, uint32_t *previous,
+                      uint32_t tolerance);
+
+#endif // FILTER_H
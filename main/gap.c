@@ -5,8 +5,11 @@
  */
 /* Includes */
 #include "gap.h"
+#include "app_config.h"
+#include "clock_sync.h"
 #include "common.h"
 #include "gatt_svc.h"
+#include "notify.h"
 
 /* Private function declarations */
 inline static void format_addr(char *addr_str, uint8_t addr[]);
@@ -16,6 +19,14 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg);
 
 /* Private variables */
 static uint8_t own_addr_type;
+static int connection_count = 0;
+/* Advertising intervals in use, to tell when the configuration changes them */
+static uint16_t adv_itvl_min_ms;
+static uint16_t adv_itvl_max_ms;
+/* Fast advertising after a stack reset lasts until this time, counted from
+ * when the host synced again */
+static bool fast_adv_pending = false;
+static TickType_t fast_adv_until;
 static uint8_t addr_val[6] = {0};
 static uint8_t esp_uri[] = {BLE_GAP_URI_PREFIX_HTTPS, '/', '/', 'e', 's', 'p', 'r', 'e', 's', 's', 'i', 'f', '.', 'c', 'o', 'm'};
 
@@ -65,6 +76,35 @@ static void start_advertising(void) {
     e.g. connection mode (undirected/directed)
     */
     struct ble_gap_adv_params adv_params = {0};
+    struct app_config config;
+#if GATEWAY_ENABLED
+    /* Lets clients find the aggregate service. A gateway doesn't list FFF0, so
+     * other gateways don't take it for a node and relay its relayed values */
+    static const ble_uuid16_t adv_uuids16[] = {BLE_UUID16_INIT(0xFFD0)};
+#else
+    /* Lets gateways (see gateway.h) recognize this node */
+    static const ble_uuid16_t adv_uuids16[] = {BLE_UUID16_INIT(0xFFF0)};
+#endif
+    int32_t duration_ms = BLE_HS_FOREVER;
+    TickType_t now = xTaskGetTickCount();
+
+    /* Keep advertising while there is room for more centrals */
+    if (ble_gap_adv_active() || connection_count >= GAP_MAX_CONNECTIONS) {
+        return;
+    }
+
+    /* Advertising intervals come from the runtime configuration, except for a
+     * while after a stack reset */
+    app_config_get(&config);
+    adv_itvl_min_ms = config.adv_itvl_min_ms;
+    adv_itvl_max_ms = config.adv_itvl_max_ms;
+    if (fast_adv_pending && (int32_t)(fast_adv_until - now) > 0) {
+        adv_itvl_min_ms = GAP_FAST_ADV_ITVL_MIN_MS;
+        adv_itvl_max_ms = GAP_FAST_ADV_ITVL_MAX_MS;
+        duration_ms = (fast_adv_until - now) * portTICK_PERIOD_MS;
+    } else {
+        fast_adv_pending = false;
+    }
 
     /* Set advertising flags */
     adv_fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
@@ -87,6 +127,11 @@ static void start_advertising(void) {
     adv_fields.le_role = BLE_GAP_LE_ROLE_PERIPHERAL;
     adv_fields.le_role_is_present = 1;
 
+    /* Advertise the potentiometer service, or the aggregate service on a gateway */
+    adv_fields.uuids16 = adv_uuids16;
+    adv_fields.num_uuids16 = 1;
+    adv_fields.uuids16_is_complete = 0;
+
     /* Set advertiement fields */
     rc = ble_gap_adv_set_fields(&adv_fields);
     if (rc != 0) {
@@ -104,7 +149,7 @@ static void start_advertising(void) {
     rsp_fields.uri_len = sizeof(esp_uri);
 
     /* Set advertising interval */
-    rsp_fields.adv_itvl = BLE_GAP_ADV_ITVL_MS(500);
+    rsp_fields.adv_itvl = BLE_GAP_ADV_ITVL_MS(adv_itvl_min_ms);
     rsp_fields.adv_itvl_is_present = 1;
 
     /* Set scan response fields */
@@ -119,11 +164,11 @@ static void start_advertising(void) {
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
 
     /* Set advertising interval */
-    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(500);
-    adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(510);
+    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(adv_itvl_min_ms);
+    adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(adv_itvl_max_ms);
 
     /* Start advertising */
-    rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params,
+    rc = ble_gap_adv_start(own_addr_type, NULL, duration_ms, &adv_params,
                            gap_event_handler, NULL);
     if (rc != 0) {
         ESP_LOGE(TAG, "failed to start advertising, error code: %d", rc);
@@ -154,6 +199,10 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
 
         /* Connection succeeded */
         if (event->connect.status == 0) {
+            /* Advertising stops on connect; resume it so more centrals can join */
+            connection_count++;
+            start_advertising();
+
             /* Check connection handle */
             rc = ble_gap_conn_find(event->connect.conn_handle, &desc);
             if (rc != 0) {
@@ -193,6 +242,14 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
         ESP_LOGI(TAG, "disconnected from peer; reason=%d",
                  event->disconnect.reason);
 
+        /* Stop notifying the peer */
+        notify_disconnect(event->disconnect.conn.conn_handle);
+        gateway_client_disconnect(event->disconnect.conn.conn_handle);
+        clock_sync_disconnect(event->disconnect.conn.conn_handle);
+        if (connection_count > 0) {
+            connection_count--;
+        }
+
         /* Restart advertising */
         start_advertising();
         return rc;
@@ -223,6 +280,10 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
 
     /* Notification sent event */
     case BLE_GAP_EVENT_NOTIFY_TX:
+        /* Close the flow control window for this notification */
+        notify_tx_complete(event->notify_tx.conn_handle,
+                           event->notify_tx.attr_handle,
+                           event->notify_tx.status);
         if ((event->notify_tx.status != 0) &&
             (event->notify_tx.status != BLE_HS_EDONE)) {
             /* Print notification info on error */
@@ -249,6 +310,33 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
         gatt_svr_subscribe_cb(event);
         return rc;
 
+    /* Encryption change event */
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        /* Pairing or re-encryption with a bonded central finished */
+        ESP_LOGI(TAG, "encryption change event; status=%d",
+                 event->enc_change.status);
+        rc = ble_gap_conn_find(event->enc_change.conn_handle, &desc);
+        if (rc != 0) {
+            ESP_LOGE(TAG, "failed to find connection by handle, error code: %d",
+                     rc);
+            return rc;
+        }
+        print_conn_desc(&desc);
+        return rc;
+
+    /* Repeat pairing event */
+    case BLE_GAP_EVENT_REPEAT_PAIRING:
+        /* A bonded central lost its keys and pairs again: forget the old bond
+         * and let the new pairing go ahead */
+        rc = ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc);
+        if (rc != 0) {
+            ESP_LOGE(TAG, "failed to find connection by handle, error code: %d",
+                     rc);
+            return BLE_GAP_REPEAT_PAIRING_IGNORE;
+        }
+        ble_store_util_delete_peer(&desc.peer_id_addr);
+        return BLE_GAP_REPEAT_PAIRING_RETRY;
+
     /* MTU update event */
     case BLE_GAP_EVENT_MTU:
         /* Print MTU update info to log */
@@ -291,10 +379,44 @@ void adv_init(void) {
     format_addr(addr_str, addr_val);
     ESP_LOGI(TAG, "device address: %s", addr_str);
 
+    /* After a reset, advertise fast for the full duration from now; the
+     * host may have taken a while to sync with the controller again */
+    if (fast_adv_pending) {
+        fast_adv_until = xTaskGetTickCount() + pdMS_TO_TICKS(GAP_FAST_ADV_DURATION_MS);
+    }
+
     /* Start advertising. */
     start_advertising();
 }
 
+int gap_connection_count(void) {
+    return connection_count;
+}
+
+void gap_reset(void) {
+    /* The reset dropped every connection */
+    connection_count = 0;
+    /* The fast advertising period starts in adv_init, once the host has synced */
+    fast_adv_pending = true;
+}
+
+void gap_config_changed(void) {
+    /* Local variables */
+    struct app_config config;
+
+    app_config_get(&config);
+    /* Fast advertising after a reset ends on its own and picks up the change */
+    if (!ble_gap_adv_active() || fast_adv_pending ||
+        (config.adv_itvl_min_ms == adv_itvl_min_ms &&
+                                  config.adv_itvl_max_ms == adv_itvl_max_ms)) {
+        return;
+    }
+
+    /* Advertising parameters can't be changed while advertising */
+    ble_gap_adv_stop();
+    start_advertising();
+}
+
 int gap_init(void) {
     /* Local variables */
     int rc = 0;
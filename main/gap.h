@@ -4,6 +4,9 @@
 #define GAP_SVC_H
 
 /* Includes */
+#include "sdkconfig.h"
+#include "gateway.h"
+
 /* NimBLE GAP APIs */
 #include "host/ble_gap.h"
 #include "services/gap/ble_svc_gap.h"
@@ -12,6 +15,19 @@
 #define BLE_GAP_APPEARANCE_GENERIC_TAG 0x0200
 #define BLE_GAP_URI_PREFIX_HTTPS 0x17
 #define BLE_GAP_LE_ROLE_PERIPHERAL 0x00
+#if GATEWAY_ENABLED
+/* The remaining connections are reserved for the gateway's peers */
+#define GAP_MAX_CONNECTIONS (CONFIG_BT_NIMBLE_MAX_CONNECTIONS - GATEWAY_MAX_PEERS)
+#else
+#define GAP_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#endif
+/* Default advertising interval range, see app_config.h */
+#define GAP_ADV_ITVL_MIN_MS 500
+#define GAP_ADV_ITVL_MAX_MS 510
+/* After a stack reset, advertise fast for a while so centrals reconnect quickly */
+#define GAP_FAST_ADV_ITVL_MIN_MS 30
+#define GAP_FAST_ADV_ITVL_MAX_MS 60
+#define GAP_FAST_ADV_DURATION_MS 30000
 
 /* Function to start advertising 
 
@@ -28,4 +44,15 @@ allowing central devices to see what they are connecting to.
 */
 int gap_init(void);
 
+/* Number of centrals currently connected */
+int gap_connection_count(void);
+
+/* Forget all connections after a NimBLE host reset and advertise fast once
+ * the host has synced again */
+void gap_reset(void);
+
+/* Restart advertising if the configured advertising intervals changed.
+ * Must be called from the NimBLE host task */
+void gap_config_changed(void);
+
 #endif // GAP_SVC_H
\ No newline at end of file
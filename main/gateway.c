@@ -0,0 +1,701 @@
+/* Implementations for gateway.h */
+
+/* Header */
+#include "gateway.h"
+
+#if GATEWAY_ENABLED
+/* Compile ESP_LOGI in for this file so the gateway report can be enabled on its
+ * own (see gateway_task); the other Info lines stay filtered at run time */
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#endif
+
+/* Includes */
+#include "app_config.h"
+#include "ble.h"
+#include "common.h"
+#include "esp_timer.h"
+#include "gap.h"
+#include "gatt_svc.h"
+
+#if GATEWAY_ENABLED
+
+_Static_assert(GATEWAY_MAX_PEERS > 0, "gateway mode needs CONFIG_BT_NIMBLE_MAX_CONNECTIONS > 1");
+_Static_assert(GATEWAY_MAX_PEERS <= 32, "client peer masks hold one bit per peer slot");
+
+#define GATEWAY_LOG_NAME "GATEWAY"
+#define GATEWAY_REPORT_LOG_NAME "GATEWAY_REPORT"
+
+/* Connection progress of a peer */
+enum gateway_peer_state {
+    PEER_FREE,
+    PEER_CONNECTING,
+    PEER_DISCOVERING,   // Looking for the service, FFF1 and its CCCD
+    PEER_SUBSCRIBING,   // CCCD write in progress
+    PEER_ACTIVE,
+};
+
+/* One peer node */
+struct gateway_peer {
+    enum gateway_peer_state state;
+    uint16_t conn_handle;
+    ble_addr_t addr;
+    uint32_t node_id;      // Low four bytes of the peer's address
+    uint16_t svc_end;      // Last handle of the peer's potentiometer service
+    uint16_t val_handle;   // Peer's FFF1 value handle
+    uint16_t cccd_handle;  // Peer's FFF1 client characteristic configuration
+    uint16_t value;        // Latest value received
+    uint8_t seq;           // Values received, wraps
+    int64_t received_us;   // When value was received
+};
+
+/* One client subscribed to the aggregate characteristic */
+struct gateway_client {
+    uint16_t conn_handle;  // BLE_HS_CONN_HANDLE_NONE if unused
+    uint8_t batch_seq;     // Sequence number of the client's next batch
+    uint32_t pending;      // Peers (one bit per slot) whose record the client is due
+    uint32_t fresh;        // Pending peers with a value received since the client was last sent one
+};
+
+/* Private variables */
+static struct gateway_peer gateway_peers[GATEWAY_MAX_PEERS];
+static struct gateway_client gateway_clients[GAP_MAX_CONNECTIONS];
+static struct gateway_stats gateway_stats;
+static uint8_t own_addr_type;
+static bool gateway_synced;
+/* The peer table and clients are shared between the NimBLE host task and the gateway task */
+static portMUX_TYPE gateway_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const ble_uuid16_t peer_svc_uuid = BLE_UUID16_INIT(0xFFF0);
+static const ble_uuid16_t peer_chr_uuid = BLE_UUID16_INIT(0xFFF1);
+
+/* Private function declarations */
+static int gateway_gap_event(struct ble_gap_event *event, void *arg);
+
+/* Private functions */
+/* Must be called with gateway_lock held */
+static struct gateway_peer *find_peer_by_conn(uint16_t conn_handle) {
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        if (gateway_peers[i].state != PEER_FREE &&
+            gateway_peers[i].conn_handle == conn_handle) {
+            return &gateway_peers[i];
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with gateway_lock held */
+static bool is_known_peer(const ble_addr_t *addr) {
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        if (gateway_peers[i].state != PEER_FREE &&
+            memcmp(&gateway_peers[i].addr, addr, sizeof(*addr)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Must be called with gateway_lock held */
+static struct gateway_peer *free_peer_slot(void) {
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        if (gateway_peers[i].state == PEER_FREE) {
+            return &gateway_peers[i];
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with gateway_lock held */
+static bool connecting(void) {
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        if (gateway_peers[i].state == PEER_CONNECTING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Must be called with gateway_lock held */
+static struct gateway_client *find_client(uint16_t conn_handle) {
+    for (int i = 0; i < GAP_MAX_CONNECTIONS; i++) {
+        if (gateway_clients[i].conn_handle == conn_handle) {
+            return &gateway_clients[i];
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with gateway_lock held */
+static void release_peer(struct gateway_peer *peer) {
+    uint32_t bit = 1u << (peer - gateway_peers);
+
+    if (peer->state == PEER_ACTIVE) {
+        gateway_stats.peers--;
+    }
+    memset(peer, 0, sizeof(*peer));
+    for (int i = 0; i < GAP_MAX_CONNECTIONS; i++) {
+        gateway_clients[i].pending &= ~bit;
+        gateway_clients[i].fresh &= ~bit;
+    }
+}
+
+/* Scan for peers while there is a free slot and no connection attempt in progress.
+ * The scan window takes one connection event slot per interval */
+static void start_scan(void) {
+    /* Local variables */
+    int rc;
+    bool room;
+    struct ble_gap_disc_params disc_params = {
+        .itvl = GATEWAY_CONN_ITVL_UNITS * 2,  // 0.625 ms units
+        .window = GATEWAY_SLOT_UNITS * 2,
+        .passive = 1,
+        .filter_duplicates = 1,
+    };
+
+    portENTER_CRITICAL(&gateway_lock);
+    room = free_peer_slot() != NULL && !connecting();
+    portEXIT_CRITICAL(&gateway_lock);
+
+    if (!gateway_synced || !room || ble_gap_disc_active()) {
+        return;
+    }
+    rc = ble_gap_disc(own_addr_type, BLE_HS_FOREVER, &disc_params,
+                      gateway_gap_event, NULL);
+    if (rc != 0) {
+        ESP_LOGE(GATEWAY_LOG_NAME, "failed to start scanning, error code: %d", rc);
+    }
+}
+
+/* True if an advertisement lists the potentiometer service */
+static bool advertises_potentiometer(const struct ble_gap_disc_desc *disc) {
+    struct ble_hs_adv_fields fields;
+
+    if (ble_hs_adv_parse_fields(&fields, disc->data, disc->length_data) != 0) {
+        return false;
+    }
+    for (int i = 0; i < fields.num_uuids16; i++) {
+        if (ble_uuid_u16(&fields.uuids16[i].u) == peer_svc_uuid.value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Connect to a newly discovered peer */
+static void connect_peer(const struct ble_gap_disc_desc *disc) {
+    /* Local variables */
+    int rc;
+    struct gateway_peer *peer = NULL;
+    /* Every peer connection gets the same interval: one slot for each peer,
+     * the client connection and the scan window */
+    struct ble_gap_conn_params conn_params = {
+        .scan_itvl = GATEWAY_CONN_ITVL_UNITS * 2,
+        .scan_window = GATEWAY_SLOT_UNITS * 2,
+        .itvl_min = GATEWAY_CONN_ITVL_UNITS,
+        .itvl_max = GATEWAY_CONN_ITVL_UNITS,
+        .latency = 0,
+        .supervision_timeout = GATEWAY_SUPERVISION_TIMEOUT,
+        .min_ce_len = GATEWAY_SLOT_UNITS * 2,
+        .max_ce_len = GATEWAY_SLOT_UNITS * 2,
+    };
+
+    portENTER_CRITICAL(&gateway_lock);
+    if (!is_known_peer(&disc->addr) && !connecting()) {
+        peer = free_peer_slot();
+        if (peer != NULL) {
+            peer->state = PEER_CONNECTING;
+            peer->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+            peer->addr = disc->addr;
+            peer->node_id = (uint32_t)disc->addr.val[0] | (uint32_t)disc->addr.val[1] << 8 |
+                            (uint32_t)disc->addr.val[2] << 16 | (uint32_t)disc->addr.val[3] << 24;
+        }
+    }
+    portEXIT_CRITICAL(&gateway_lock);
+    if (peer == NULL) {
+        return;
+    }
+
+    /* The controller can't scan and initiate at the same time */
+    ble_gap_disc_cancel();
+    rc = ble_gap_connect(own_addr_type, &disc->addr, GATEWAY_CONNECT_TIMEOUT_MS,
+                         &conn_params, gateway_gap_event, peer);
+    if (rc != 0) {
+        ESP_LOGE(GATEWAY_LOG_NAME, "failed to connect to peer, error code: %d", rc);
+        portENTER_CRITICAL(&gateway_lock);
+        release_peer(peer);
+        portEXIT_CRITICAL(&gateway_lock);
+        start_scan();
+    }
+}
+
+/* Give up on a peer that doesn't behave like this firmware */
+static void drop_peer(struct gateway_peer *peer, const char *step, int status) {
+    ESP_LOGW(GATEWAY_LOG_NAME, "peer %08" PRIx32 ": %s failed, status=%d",
+             peer->node_id, step, status);
+    ble_gap_terminate(peer->conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+}
+
+static int on_subscribed(uint16_t conn_handle, const struct ble_gatt_error *error,
+                         struct ble_gatt_attr *attr, void *arg) {
+    struct gateway_peer *peer = arg;
+
+    if (error->status != 0) {
+        drop_peer(peer, "subscribe", error->status);
+        return 0;
+    }
+    portENTER_CRITICAL(&gateway_lock);
+    peer->state = PEER_ACTIVE;
+    gateway_stats.peers++;
+    portEXIT_CRITICAL(&gateway_lock);
+    ESP_LOGI(GATEWAY_LOG_NAME, "peer %08" PRIx32 " subscribed; conn_handle=%d",
+             peer->node_id, conn_handle);
+    return 0;
+}
+
+static int on_disc_dsc(uint16_t conn_handle, const struct ble_gatt_error *error,
+                       uint16_t chr_val_handle, const struct ble_gatt_dsc *dsc,
+                       void *arg) {
+    /* Local variables */
+    struct gateway_peer *peer = arg;
+    static const uint8_t enable_notify[2] = {0x01, 0x00};
+    int rc;
+
+    if (error->status == 0) {
+        /* The CCCD is the first 0x2902 after the value handle */
+        if (peer->cccd_handle == 0 &&
+            ble_uuid_u16(&dsc->uuid.u) == BLE_GATT_DSC_CLT_CFG_UUID16) {
+            peer->cccd_handle = dsc->handle;
+        }
+        return 0;
+    }
+    if (error->status != BLE_HS_EDONE || peer->cccd_handle == 0) {
+        drop_peer(peer, "descriptor discovery", error->status);
+        return 0;
+    }
+
+    peer->state = PEER_SUBSCRIBING;
+    rc = ble_gattc_write_flat(conn_handle, peer->cccd_handle, enable_notify,
+                              sizeof(enable_notify), on_subscribed, peer);
+    if (rc != 0) {
+        drop_peer(peer, "subscribe", rc);
+    }
+    return 0;
+}
+
+static int on_disc_chr(uint16_t conn_handle, const struct ble_gatt_error *error,
+                       const struct ble_gatt_chr *chr, void *arg) {
+    struct gateway_peer *peer = arg;
+    int rc;
+
+    if (error->status == 0) {
+        peer->val_handle = chr->val_handle;
+        return 0;
+    }
+    if (error->status != BLE_HS_EDONE || peer->val_handle == 0) {
+        drop_peer(peer, "characteristic discovery", error->status);
+        return 0;
+    }
+
+    rc = ble_gattc_disc_all_dscs(conn_handle, peer->val_handle, peer->svc_end,
+                                 on_disc_dsc, peer);
+    if (rc != 0) {
+        drop_peer(peer, "descriptor discovery", rc);
+    }
+    return 0;
+}
+
+static int on_disc_svc(uint16_t conn_handle, const struct ble_gatt_error *error,
+                       const struct ble_gatt_svc *service, void *arg) {
+    struct gateway_peer *peer = arg;
+    int rc;
+
+    if (error->status == 0) {
+        peer->svc_end = service->end_handle;
+        peer->val_handle = service->start_handle;  // Start of the characteristic search
+        return 0;
+    }
+    if (error->status != BLE_HS_EDONE || peer->svc_end == 0) {
+        drop_peer(peer, "service discovery", error->status);
+        return 0;
+    }
+
+    uint16_t svc_start = peer->val_handle;
+    peer->val_handle = 0;
+    rc = ble_gattc_disc_chrs_by_uuid(conn_handle, svc_start, peer->svc_end,
+                                     &peer_chr_uuid.u, on_disc_chr, peer);
+    if (rc != 0) {
+        drop_peer(peer, "characteristic discovery", rc);
+    }
+    return 0;
+}
+
+/* Store a value notified by a peer */
+static void peer_value_received(const struct ble_gap_event *event) {
+    /* Local variables */
+    uint8_t payload[POTENTIOMETER_PAYLOAD_LEN];
+    uint16_t len = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    if (ble_hs_mbuf_to_flat(event->notify_rx.om, payload, sizeof(payload), &len) != 0 ||
+        len < sizeof(payload)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&gateway_lock);
+    struct gateway_peer *peer = find_peer_by_conn(event->notify_rx.conn_handle);
+    if (peer != NULL && peer->state == PEER_ACTIVE &&
+        event->notify_rx.attr_handle == peer->val_handle) {
+        uint32_t bit = 1u << (peer - gateway_peers);
+        peer->value = (uint16_t)(payload[0] | payload[1] << 8);
+        peer->seq++;
+        peer->received_us = now_us;
+        gateway_stats.received++;
+        /* Due to every subscribed client */
+        for (int i = 0; i < GAP_MAX_CONNECTIONS; i++) {
+            if (gateway_clients[i].conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+                gateway_clients[i].pending |= bit;
+                gateway_clients[i].fresh |= bit;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&gateway_lock);
+}
+
+/* GAP events of the gateway's scan and of its peer connections */
+static int gateway_gap_event(struct ble_gap_event *event, void *arg) {
+    /* Local variables */
+    struct gateway_peer *peer = arg;
+    int rc;
+
+    switch (event->type) {
+
+    /* Advertisement received while scanning */
+    case BLE_GAP_EVENT_DISC:
+        if (advertises_potentiometer(&event->disc)) {
+            connect_peer(&event->disc);
+        }
+        return 0;
+
+    /* Scan stopped, e.g. to connect */
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+        start_scan();
+        return 0;
+
+    /* Connection to a peer established or failed */
+    case BLE_GAP_EVENT_CONNECT:
+        if (event->connect.status != 0) {
+            portENTER_CRITICAL(&gateway_lock);
+            release_peer(peer);
+            portEXIT_CRITICAL(&gateway_lock);
+            start_scan();
+            return 0;
+        }
+        portENTER_CRITICAL(&gateway_lock);
+        peer->conn_handle = event->connect.conn_handle;
+        peer->state = PEER_DISCOVERING;
+        portEXIT_CRITICAL(&gateway_lock);
+
+        rc = ble_gattc_disc_svc_by_uuid(event->connect.conn_handle,
+                                        &peer_svc_uuid.u, on_disc_svc, peer);
+        if (rc != 0) {
+            drop_peer(peer, "service discovery", rc);
+        }
+        start_scan();
+        return 0;
+
+    /* Peer connection lost */
+    case BLE_GAP_EVENT_DISCONNECT:
+        ESP_LOGI(GATEWAY_LOG_NAME, "peer %08" PRIx32 " disconnected; reason=%d",
+                 peer->node_id, event->disconnect.reason);
+        portENTER_CRITICAL(&gateway_lock);
+        release_peer(peer);
+        portEXIT_CRITICAL(&gateway_lock);
+        start_scan();
+        return 0;
+
+    /* Value notified by a peer */
+    case BLE_GAP_EVENT_NOTIFY_RX:
+        peer_value_received(event);
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
+/* Encode one record. Must be called with gateway_lock held */
+static void encode_record(const struct gateway_peer *peer, uint8_t *record) {
+    record[0] = (uint8_t)(peer->node_id & 0xFF);
+    record[1] = (uint8_t)(peer->node_id >> 8);
+    record[2] = (uint8_t)(peer->node_id >> 16);
+    record[3] = (uint8_t)(peer->node_id >> 24);
+    record[4] = (uint8_t)(peer->value & 0xFF);
+    record[5] = (uint8_t)(peer->value >> 8);
+    record[6] = peer->seq;
+    record[7] = (peer->state == PEER_ACTIVE) ? GATEWAY_RECORD_CONNECTED : 0;
+}
+
+/* Must be called with gateway_lock held */
+static void record_latency(int64_t received_us, int64_t now_us) {
+    uint32_t latency_us = (uint32_t)(now_us - received_us);
+
+    if (gateway_stats.latency_count == 0 || latency_us < gateway_stats.latency_min_us) {
+        gateway_stats.latency_min_us = latency_us;
+    }
+    if (latency_us > gateway_stats.latency_max_us) {
+        gateway_stats.latency_max_us = latency_us;
+    }
+    gateway_stats.latency_total_us += latency_us;
+    gateway_stats.latency_count++;
+}
+
+/* Send a client the records it is due, in batches as large as its MTU allows.
+ * due is a copy of the client's state taken with the records. Records that
+ * could not be sent stay due for the next pass */
+static void send_client_batches(struct gateway_client *client, const struct gateway_client *due,
+                                const uint8_t *records, const int64_t *received_us) {
+    /* Local variables */
+    uint8_t payload[GATEWAY_HEADER_LEN + GATEWAY_MAX_PEERS * GATEWAY_RECORD_LEN];
+    uint8_t peers[GATEWAY_MAX_PEERS];
+    uint8_t batch_seq = due->batch_seq;
+    int count = 0;
+
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        if (due->pending & (1u << i)) {
+            peers[count++] = (uint8_t)i;
+        }
+    }
+
+    /* Notification payload is the ATT MTU less the opcode and handle */
+    int per_batch = ((int)ble_att_mtu(due->conn_handle) - 3 - GATEWAY_HEADER_LEN) / GATEWAY_RECORD_LEN;
+    if (per_batch < 1) {
+        per_batch = 1;
+    }
+    for (int first = 0; first < count; first += per_batch) {
+        int n = (count - first < per_batch) ? count - first : per_batch;
+        size_t len = GATEWAY_HEADER_LEN + n * GATEWAY_RECORD_LEN;
+        payload[0] = batch_seq;
+        payload[1] = (uint8_t)n;
+        for (int r = 0; r < n; r++) {
+            memcpy(&payload[GATEWAY_HEADER_LEN + r * GATEWAY_RECORD_LEN],
+                   &records[peers[first + r] * GATEWAY_RECORD_LEN], GATEWAY_RECORD_LEN);
+        }
+
+        int rc = send_aggregate_notification(due->conn_handle, payload, len);
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&gateway_lock);
+        bool subscribed = client->conn_handle == due->conn_handle;
+        if (rc == 0) {
+            batch_seq++;
+            gateway_stats.batches++;
+            gateway_stats.records += n;
+            gateway_stats.bytes += len;
+            /* Only values the client had not been sent count towards latency,
+             * not the latest values a new client is started off with */
+            for (int r = 0; r < n; r++) {
+                if (due->fresh & (1u << peers[first + r])) {
+                    record_latency(received_us[peers[first + r]], now_us);
+                }
+            }
+        } else {
+            gateway_stats.failed++;
+            /* Keep this batch and the rest due, unless the client went away */
+            for (int r = first; r < count && subscribed; r++) {
+                uint32_t bit = 1u << peers[r];
+                client->pending |= bit;
+                client->fresh |= bit & due->fresh;
+            }
+        }
+        if (subscribed) {
+            client->batch_seq = batch_seq;
+        }
+        portEXIT_CRITICAL(&gateway_lock);
+        if (rc != 0) {
+            return;
+        }
+    }
+}
+
+/* Send every subscribed client the peer records it is due */
+static void send_batches(void) {
+    /* Local variables */
+    uint8_t records[GATEWAY_MAX_PEERS * GATEWAY_RECORD_LEN];
+    int64_t received_us[GATEWAY_MAX_PEERS];
+    struct gateway_client due[GAP_MAX_CONNECTIONS];
+
+    /* Encode every peer once and take what each client is due at the same time,
+     * so a value received meanwhile stays due */
+    portENTER_CRITICAL(&gateway_lock);
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        encode_record(&gateway_peers[i], &records[i * GATEWAY_RECORD_LEN]);
+        received_us[i] = gateway_peers[i].received_us;
+    }
+    memcpy(due, gateway_clients, sizeof(due));
+    for (int c = 0; c < GAP_MAX_CONNECTIONS; c++) {
+        gateway_clients[c].pending = 0;
+        gateway_clients[c].fresh = 0;
+    }
+    portEXIT_CRITICAL(&gateway_lock);
+
+    for (int c = 0; c < GAP_MAX_CONNECTIONS; c++) {
+        if (due[c].conn_handle != BLE_HS_CONN_HANDLE_NONE && due[c].pending != 0) {
+            send_client_batches(&gateway_clients[c], &due[c], records, received_us);
+        }
+    }
+}
+
+/* Batches values at the configured notify period and reports the counters */
+static void gateway_task(void *param) {
+    /* Local variables */
+    struct app_config config;
+    struct gateway_stats stats;
+    uint32_t prev_records = 0;
+    int64_t prev_report_us = esp_timer_get_time();
+
+    /* Printed whatever the default log level */
+    esp_log_level_set(GATEWAY_REPORT_LOG_NAME, ESP_LOG_INFO);
+
+    while (true) {
+        app_config_get(&config);
+        vTaskDelay(pdMS_TO_TICKS(config.notify_period_ms));
+        send_batches();
+
+        int64_t now_us = esp_timer_get_time();
+        if (BLE_STATS_PERIOD_MS > 0 && now_us - prev_report_us >= BLE_STATS_PERIOD_MS * 1000LL) {
+            gateway_get_stats(&stats);
+            uint32_t elapsed_ms = (uint32_t)((now_us - prev_report_us) / 1000);
+            ESP_LOGI(GATEWAY_REPORT_LOG_NAME,
+                     "gateway: peers=%" PRIu32 " received=%" PRIu32 " batches=%" PRIu32
+                     " records=%" PRIu32 " bytes=%" PRIu32 " failed=%" PRIu32
+                     " records_per_s=%" PRIu32
+                     " latency_us min/avg/max=%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+                     stats.peers, stats.received, stats.batches, stats.records,
+                     stats.bytes, stats.failed,
+                     elapsed_ms ? (stats.records - prev_records) * 1000 / elapsed_ms : 0,
+                     stats.latency_min_us,
+                     stats.latency_count
+                         ? (uint32_t)(stats.latency_total_us / stats.latency_count)
+                         : 0,
+                     stats.latency_max_us);
+            prev_records = stats.records;
+            prev_report_us = now_us;
+        }
+    }
+}
+
+/* Public functions */
+void gateway_init(void) {
+    for (int i = 0; i < GAP_MAX_CONNECTIONS; i++) {
+        gateway_clients[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    }
+    xTaskCreate(gateway_task, "Gateway", 3*1024, NULL, 4, NULL);
+}
+
+void gateway_start(void) {
+    int rc = ble_hs_id_infer_auto(0, &own_addr_type);
+    if (rc != 0) {
+        ESP_LOGE(GATEWAY_LOG_NAME, "failed to infer address type, error code: %d", rc);
+        return;
+    }
+    gateway_synced = true;
+    start_scan();
+}
+
+void gateway_reset(void) {
+    portENTER_CRITICAL(&gateway_lock);
+    gateway_synced = false;
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        release_peer(&gateway_peers[i]);
+    }
+    for (int i = 0; i < GAP_MAX_CONNECTIONS; i++) {
+        gateway_clients[i] = (struct gateway_client){.conn_handle = BLE_HS_CONN_HANDLE_NONE};
+    }
+    portEXIT_CRITICAL(&gateway_lock);
+}
+
+void gateway_subscribe(uint16_t conn_handle, bool enabled) {
+    struct gateway_client *client;
+
+    portENTER_CRITICAL(&gateway_lock);
+    client = find_client(conn_handle);
+    if (client != NULL) {
+        *client = (struct gateway_client){.conn_handle = BLE_HS_CONN_HANDLE_NONE};
+    }
+    client = enabled ? find_client(BLE_HS_CONN_HANDLE_NONE) : NULL;
+    if (client != NULL) {
+        client->conn_handle = conn_handle;
+        /* Start the new client off with every peer's latest value. These are
+         * not fresh, so they don't count towards delivery latency */
+        for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+            if (gateway_peers[i].state == PEER_ACTIVE) {
+                client->pending |= 1u << i;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&gateway_lock);
+}
+
+void gateway_client_disconnect(uint16_t conn_handle) {
+    gateway_subscribe(conn_handle, false);
+}
+
+size_t gateway_encode_all(uint16_t conn_handle, uint8_t *payload, size_t len) {
+    const struct gateway_client *client;
+    size_t used = GATEWAY_HEADER_LEN;
+    uint8_t count = 0;
+
+    if (len < GATEWAY_HEADER_LEN) {
+        return 0;
+    }
+    portENTER_CRITICAL(&gateway_lock);
+    for (int i = 0; i < GATEWAY_MAX_PEERS; i++) {
+        if (gateway_peers[i].state == PEER_ACTIVE && used + GATEWAY_RECORD_LEN <= len) {
+            encode_record(&gateway_peers[i], &payload[used]);
+            used += GATEWAY_RECORD_LEN;
+            count++;
+        }
+    }
+    client = find_client(conn_handle);
+    payload[0] = (client != NULL) ? client->batch_seq : 0;
+    payload[1] = count;
+    portEXIT_CRITICAL(&gateway_lock);
+    return used;
+}
+
+void gateway_get_stats(struct gateway_stats *stats) {
+    portENTER_CRITICAL(&gateway_lock);
+    *stats = gateway_stats;
+    portEXIT_CRITICAL(&gateway_lock);
+}
+
+#else  // GATEWAY_ENABLED
+
+void gateway_init(void) {
+}
+
+void gateway_start(void) {
+}
+
+void gateway_reset(void) {
+}
+
+void gateway_subscribe(uint16_t conn_handle, bool enabled) {
+    (void)conn_handle;
+    (void)enabled;
+}
+
+void gateway_client_disconnect(uint16_t conn_handle) {
+    (void)conn_handle;
+}
+
+size_t gateway_encode_all(uint16_t conn_handle, uint8_t *payload, size_t len) {
+    (void)conn_handle;
+    (void)payload;
+    (void)len;
+    return 0;
+}
+
+void gateway_get_stats(struct gateway_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif  // GATEWAY_ENABLED
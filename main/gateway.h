@@ -0,0 +1,76 @@
+/* Gateway (aggregator) mode
+
+With GATEWAY_ENABLED set, the device is also a BLE central. It scans for other
+nodes running this firmware (advertising service 0xFFF0), connects to up to
+GATEWAY_MAX_PEERS of them, subscribes to their FFF1 characteristic and
+republishes every peer's value, tagged with the peer's node ID, as batched
+notifications of its own aggregate characteristic (0xFFD1 in service 0xFFD0).
+One client connection then serves the whole group. A gateway advertises 0xFFD0
+rather than 0xFFF0, so other gateways don't take it for a node.
+
+All peer connections use the same connection interval, sized so each peer, the
+client connection and a scan window get one connection event slot of
+GATEWAY_SLOT_UNITS per interval, so the controller can lay their events out
+side by side instead of letting them collide.
+*/
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "sdkconfig.h"
+
+#define GATEWAY_ENABLED              0     // Set to 1 to collect values from peer nodes
+#define GATEWAY_MAX_PEERS            (CONFIG_BT_NIMBLE_MAX_CONNECTIONS - 1)  // One connection stays free for a client
+#define GATEWAY_SLOT_UNITS           8     // Connection event slot per connection, in 1.25 ms units (10 ms)
+#define GATEWAY_CONN_ITVL_UNITS      ((GATEWAY_MAX_PEERS + 2) * GATEWAY_SLOT_UNITS)  // Peers + client + scan window
+#define GATEWAY_CONNECT_TIMEOUT_MS   5000
+#define GATEWAY_SUPERVISION_TIMEOUT  400   // In 10 ms units
+
+/* Aggregate characteristic value: a header followed by one record per peer */
+#define GATEWAY_HEADER_LEN           2     // uint8 batch sequence number, uint8 record count
+#define GATEWAY_RECORD_LEN           8     // uint32 node ID, uint16 value, uint8 peer sequence, uint8 flags
+#define GATEWAY_RECORD_CONNECTED     0x01  // Record flag: the peer is currently connected
+
+/* Aggregate throughput and latency counters */
+struct gateway_stats {
+    uint32_t peers;             // Peers currently subscribed
+    uint32_t received;          // Notifications received from peers
+    uint32_t batches;           // Aggregate notifications sent
+    uint32_t records;           // Peer records sent in those
+    uint32_t bytes;             // Aggregate payload bytes sent
+    uint32_t failed;            // Aggregate notifications the host refused
+    /* From receiving a peer's value to sending it to a client, for each client
+     * sent a value it hadn't had (not the values a new client starts with) */
+    uint32_t latency_count;
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint64_t latency_total_us;
+};
+
+/* Start the task that sends aggregate batches */
+void gateway_init(void);
+
+/* Start scanning for peers once the host has synced */
+void gateway_start(void);
+
+/* Forget all peers and clients after a NimBLE host reset */
+void gateway_reset(void);
+
+/* A client (dis)enabled notifications of the aggregate characteristic */
+void gateway_subscribe(uint16_t conn_handle, bool enabled);
+
+/* A client disconnected */
+void gateway_client_disconnect(uint16_t conn_handle);
+
+/* Encode the latest record of every peer into payload, read by the client on
+ * conn_handle. The header carries the sequence number of that client's next
+ * batch (0 if it isn't subscribed). Returns the number of bytes written, at most len */
+size_t gateway_encode_all(uint16_t conn_handle, uint8_t *payload, size_t len);
+
+/* Copy the current counters */
+void gateway_get_stats(struct gateway_stats *stats);
+
+#endif // GATEWAY_H
@@ -5,24 +5,109 @@
  */
 /* Includes */
 #include "gatt_svc.h"
+#include "adc_cal.h"
+#include "app_config.h"
+#include "clock_sync.h"
 #include "common.h"
-#include "consumer.h"
+#include "gap.h"
+#include "gateway.h"
+#include "notify.h"
+#include "snapshot.h"
+#include "trace.h"
 
 /* Private function declarations */
 static int potentiometer_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                                  struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int presentation_format_access(uint16_t conn_handle, uint16_t attr_handle,
+                                      struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int config_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int notify_params_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int sync_exchange_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int sync_status_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg);
+#if GATEWAY_ENABLED
+static int aggregate_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt, void *arg);
+#endif
+
+/* Longest value of the characteristics encoded by encode_chr_value */
+#define CHR_VALUE_MAX_LEN sizeof(struct clock_sync_value)
+
+/* Writing the configuration record needs an encrypted link (see app_config.h) */
+#if APP_CONFIG_WRITE_ENCRYPTED
+#define CONFIG_CHR_WRITE_FLAGS (BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC)
+#else
+#define CONFIG_CHR_WRITE_FLAGS BLE_GATT_CHR_F_WRITE
+#endif
 
 /* Private variables */
 /* Custom potentiometer service */
 static const ble_uuid16_t potentiometer_svc_uuid = BLE_UUID16_INIT(0xFFF0);
 
-static uint16_t potentiometer_chr_val;
 static uint16_t potentiometer_chr_val_handle;
 static const ble_uuid16_t potentiometer_chr_uuid = BLE_UUID16_INIT(0xFFF1);
 
-static uint16_t potentiometer_chr_conn_handle = 0;
-static bool potentiometer_chr_conn_handle_inited = false;
-static bool potentiometer_notify_status = false;
+/* Calibrated values, converted from the raw ADC code when read or notified */
+static uint16_t millivolts_chr_val_handle;
+static const ble_uuid16_t millivolts_chr_uuid = BLE_UUID16_INIT(0xFFF2);
+
+static uint16_t percent_chr_val_handle;
+static const ble_uuid16_t percent_chr_uuid = BLE_UUID16_INIT(0xFFF3);
+
+/* Subscription parameters of the accessing connection, struct notify_params */
+static uint16_t notify_params_chr_val_handle;
+static const ble_uuid16_t notify_params_chr_uuid = BLE_UUID16_INIT(0xFFF4);
+
+/* Characteristic Presentation Format descriptors (0x2904): format, exponent,
+ * unit, namespace and description, multi-byte fields little-endian */
+#define PRESENTATION_FORMAT_UINT16  0x06
+#define PRESENTATION_UNIT_VOLT      0x2728
+#define PRESENTATION_UNIT_PERCENT   0x27AD
+#define PRESENTATION_NAMESPACE_SIG  0x01
+#define PRESENTATION_FORMAT_LEN     7
+
+static const ble_uuid16_t presentation_format_uuid = BLE_UUID16_INIT(0x2904);
+
+static const uint8_t millivolts_format[PRESENTATION_FORMAT_LEN] = {
+    PRESENTATION_FORMAT_UINT16, (uint8_t)-3,  /* uint16 x 10^-3 V */
+    PRESENTATION_UNIT_VOLT & 0xFF, PRESENTATION_UNIT_VOLT >> 8,
+    PRESENTATION_NAMESPACE_SIG, 0x00, 0x00};
+
+static const uint8_t percent_format[PRESENTATION_FORMAT_LEN] = {
+    PRESENTATION_FORMAT_UINT16, (uint8_t)-2,  /* uint16 x 10^-2 % */
+    PRESENTATION_UNIT_PERCENT & 0xFF, PRESENTATION_UNIT_PERCENT >> 8,
+    PRESENTATION_NAMESPACE_SIG, 0x00, 0x00};
+
+/* Configuration service, one read/write characteristic holding the whole
+ * struct app_config record */
+static const ble_uuid16_t config_svc_uuid = BLE_UUID16_INIT(0xFFE0);
+
+static uint16_t config_chr_val_handle;
+static const ble_uuid16_t config_chr_uuid = BLE_UUID16_INIT(0xFFE1);
+
+/* Time sync service (see clock_sync.h) */
+static const ble_uuid16_t sync_svc_uuid = BLE_UUID16_INIT(0xFFC0);
+
+static uint16_t sync_exchange_chr_val_handle;
+static const ble_uuid16_t sync_exchange_chr_uuid = BLE_UUID16_INIT(0xFFC1);
+
+static uint16_t sync_status_chr_val_handle;
+static const ble_uuid16_t sync_status_chr_uuid = BLE_UUID16_INIT(0xFFC2);
+
+/* Latest value with its capture time on the central's clock */
+static uint16_t timestamped_chr_val_handle;
+static const ble_uuid16_t timestamped_chr_uuid = BLE_UUID16_INIT(0xFFC3);
+
+#if GATEWAY_ENABLED
+/* Gateway aggregate service, values of all peer nodes (see gateway.h) */
+static const ble_uuid16_t aggregate_svc_uuid = BLE_UUID16_INIT(0xFFD0);
+
+static uint16_t aggregate_chr_val_handle;
+static const ble_uuid16_t aggregate_chr_uuid = BLE_UUID16_INIT(0xFFD1);
+#endif
 
 /* Custom GATT Services table */
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
@@ -36,23 +121,139 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
               .access_cb = potentiometer_chr_access,
               .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
               .val_handle = &potentiometer_chr_val_handle},
+             {/* Millivolts characteristic */
+              .uuid = &millivolts_chr_uuid.u,
+              .access_cb = potentiometer_chr_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &millivolts_chr_val_handle,
+              .descriptors =
+                  (struct ble_gatt_dsc_def[]){
+                      {.uuid = &presentation_format_uuid.u,
+                       .att_flags = BLE_ATT_F_READ,
+                       .access_cb = presentation_format_access,
+                       .arg = (void *)millivolts_format},
+                      {
+                          0, /* No more descriptors. */
+                      }}},
+             {/* Position (percent) characteristic */
+              .uuid = &percent_chr_uuid.u,
+              .access_cb = potentiometer_chr_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &percent_chr_val_handle,
+              .descriptors =
+                  (struct ble_gatt_dsc_def[]){
+                      {.uuid = &presentation_format_uuid.u,
+                       .att_flags = BLE_ATT_F_READ,
+                       .access_cb = presentation_format_access,
+                       .arg = (void *)percent_format},
+                      {
+                          0, /* No more descriptors. */
+                      }}},
+             {/* Subscription parameters characteristic */
+              .uuid = &notify_params_chr_uuid.u,
+              .access_cb = notify_params_chr_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &notify_params_chr_val_handle},
+             {
+                 0, /* No more characteristics in this service. */
+             }}},
+
+    /* Configuration service */
+    {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+     .uuid = &config_svc_uuid.u,
+     .characteristics =
+         (struct ble_gatt_chr_def[]){
+             {/* Configuration record characteristic */
+              .uuid = &config_chr_uuid.u,
+              .access_cb = config_chr_access,
+              .flags = BLE_GATT_CHR_F_READ | CONFIG_CHR_WRITE_FLAGS,
+              .val_handle = &config_chr_val_handle},
              {
                  0, /* No more characteristics in this service. */
              }}},
 
+    /* Time sync service */
+    {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+     .uuid = &sync_svc_uuid.u,
+     .characteristics =
+         (struct ble_gatt_chr_def[]){
+             {/* Round trip characteristic: requests written, replies notified */
+              .uuid = &sync_exchange_chr_uuid.u,
+              .access_cb = sync_exchange_chr_access,
+              .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP |
+                       BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &sync_exchange_chr_val_handle},
+             {/* Sync status characteristic */
+              .uuid = &sync_status_chr_uuid.u,
+              .access_cb = sync_status_chr_access,
+              .flags = BLE_GATT_CHR_F_READ,
+              .val_handle = &sync_status_chr_val_handle},
+             {/* Timestamped value characteristic */
+              .uuid = &timestamped_chr_uuid.u,
+              .access_cb = potentiometer_chr_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &timestamped_chr_val_handle},
+             {
+                 0, /* No more characteristics in this service. */
+             }}},
+
+#if GATEWAY_ENABLED
+    /* Gateway aggregate service */
+    {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+     .uuid = &aggregate_svc_uuid.u,
+     .characteristics =
+         (struct ble_gatt_chr_def[]){
+             {/* Aggregate characteristic */
+              .uuid = &aggregate_chr_uuid.u,
+              .access_cb = aggregate_chr_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &aggregate_chr_val_handle},
+             {
+                 0, /* No more characteristics in this service. */
+             }}},
+#endif
+
     {
         0, /* No more services. */
     },
 };
 
 /* Private functions */
+/* Encode the current value for the characteristic with value handle attr_handle.
+ * Returns the number of bytes written, or 0 if the handle is not ours. Every
+ * read and notification of a value characteristic is encoded here, when it is
+ * sent, rather than in a pipeline stage for every sample (see README) */
+static size_t encode_chr_value(uint16_t attr_handle,
+                               const struct potentiometer_snapshot *snapshot,
+                               uint8_t *payload) {
+    uint16_t value;
+
+    if (attr_handle == potentiometer_chr_val_handle) {
+        return snapshot_encode(snapshot, payload);
+    } else if (attr_handle == millivolts_chr_val_handle) {
+        value = adc_cal_millivolts(snapshot->value);
+    } else if (attr_handle == percent_chr_val_handle) {
+        value = adc_cal_percent(snapshot->value);
+    } else if (attr_handle == timestamped_chr_val_handle) {
+        return clock_sync_encode_value(snapshot, payload);
+    } else {
+        return 0;
+    }
+    payload[0] = (uint8_t)(value & 0xFF);
+    payload[1] = (uint8_t)(value >> 8);
+    return sizeof(value);
+}
+
 static int potentiometer_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                                  struct ble_gatt_access_ctxt *ctxt, void *arg) {
     /* Local variables */
     int rc;
+    struct potentiometer_snapshot snapshot;
+    uint8_t payload[CHR_VALUE_MAX_LEN];
+    size_t payload_len;
 
     /* Handle access events */
-    /* Note: Potentiometer characteristic is read only */
+    /* Note: Potentiometer characteristics are read only */
     switch (ctxt->op) {
 
     /* Read characteristic event */
@@ -66,12 +267,11 @@ static int potentiometer_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                      attr_handle);
         }
 
-        /* Verify attribute handle */
-        if (attr_handle == potentiometer_chr_val_handle) {
-            /* Update access buffer value */
-            potentiometer_chr_val = get_potentiometer_value();
-            rc = os_mbuf_append(ctxt->om, &potentiometer_chr_val,
-                                sizeof(potentiometer_chr_val));
+        /* Append the latest published value, converted for this characteristic */
+        snapshot_read(&snapshot);
+        payload_len = encode_chr_value(attr_handle, &snapshot, payload);
+        if (payload_len > 0) {
+            rc = os_mbuf_append(ctxt->om, payload, payload_len);
             return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
         }
         goto error;
@@ -89,13 +289,229 @@ error:
     return BLE_ATT_ERR_UNLIKELY;
 }
 
+static int presentation_format_access(uint16_t conn_handle, uint16_t attr_handle,
+                                      struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    /* arg is the descriptor value from the service table */
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_DSC) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    return os_mbuf_append(ctxt->om, arg, PRESENTATION_FORMAT_LEN) == 0
+               ? 0
+               : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int config_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    /* Local variables */
+    int rc;
+    struct app_config config;
+
+    switch (ctxt->op) {
+
+    /* Read characteristic event */
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        app_config_get(&config);
+        rc = os_mbuf_append(ctxt->om, &config, sizeof(config));
+        return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+    /* Write characteristic event: the whole record is replaced at once */
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        if (OS_MBUF_PKTLEN(ctxt->om) != sizeof(config)) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        rc = ble_hs_mbuf_to_flat(ctxt->om, &config, sizeof(config), NULL);
+        if (rc != 0) {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
+        if (!app_config_set(&config)) {
+            ESP_LOGW(TAG, "rejected invalid configuration; conn_handle=%d",
+                     conn_handle);
+            return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+        }
+        ESP_LOGI(TAG, "configuration updated; conn_handle=%d", conn_handle);
+        gap_config_changed();
+        return 0;
+
+    /* Unknown event */
+    default:
+        ESP_LOGE(TAG,
+                 "unexpected access operation to configuration characteristic, "
+                 "opcode: %d",
+                 ctxt->op);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+
+#if GATEWAY_ENABLED
+static int aggregate_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    /* Local variables */
+    uint8_t payload[GATEWAY_HEADER_LEN + GATEWAY_MAX_PEERS * GATEWAY_RECORD_LEN];
+    size_t payload_len;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        ESP_LOGE(TAG,
+                 "unexpected access operation to aggregate characteristic, "
+                 "opcode: %d",
+                 ctxt->op);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    /* Latest value of every connected peer */
+    payload_len = gateway_encode_all(conn_handle, payload, sizeof(payload));
+    return os_mbuf_append(ctxt->om, payload, payload_len) == 0
+               ? 0
+               : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+#endif
+
+static int notify_params_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    /* Local variables */
+    int rc;
+    struct notify_params params;
+
+    switch (ctxt->op) {
+
+    /* Read characteristic event: this connection's parameters */
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        notify_get_params(conn_handle, &params);
+        rc = os_mbuf_append(ctxt->om, &params, sizeof(params));
+        return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+    /* Write characteristic event: all three parameters at once */
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        if (OS_MBUF_PKTLEN(ctxt->om) != sizeof(params)) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        rc = ble_hs_mbuf_to_flat(ctxt->om, &params, sizeof(params), NULL);
+        if (rc != 0) {
+            return BLE_ATT_ERR_UNLIKELY;
+        }
+        if (!notify_set_params(conn_handle, &params)) {
+            ESP_LOGW(TAG, "rejected subscription parameters; conn_handle=%d",
+                     conn_handle);
+            return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+        }
+        ESP_LOGI(TAG,
+                 "subscription parameters; conn_handle=%d min=%d max=%d deadband=%d",
+                 conn_handle, params.min_interval_ms, params.max_interval_ms,
+                 params.deadband);
+        return 0;
+
+    /* Unknown event */
+    default:
+        ESP_LOGE(TAG,
+                 "unexpected access operation to subscription parameters "
+                 "characteristic, opcode: %d",
+                 ctxt->op);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+
+static int sync_exchange_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                    struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    /* Local variables */
+    int rc;
+    struct clock_sync_request request;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        ESP_LOGE(TAG,
+                 "unexpected access operation to sync exchange characteristic, "
+                 "opcode: %d",
+                 ctxt->op);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (OS_MBUF_PKTLEN(ctxt->om) != sizeof(request)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    rc = ble_hs_mbuf_to_flat(ctxt->om, &request, sizeof(request), NULL);
+    if (rc != 0) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    /* The reply goes out as a notification; a failed one only costs this round trip */
+    rc = clock_sync_request(conn_handle, &request);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "sync reply not sent; conn_handle=%d rc=%d", conn_handle, rc);
+    }
+    return 0;
+}
+
+static int sync_status_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    /* Local variables */
+    int rc;
+    struct clock_sync_status status;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        ESP_LOGE(TAG,
+                 "unexpected access operation to sync status characteristic, "
+                 "opcode: %d",
+                 ctxt->op);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    clock_sync_get_status(&status);
+    rc = os_mbuf_append(ctxt->om, &status, sizeof(status));
+    return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static bool is_notify_chr(uint16_t attr_handle) {
+    return attr_handle == potentiometer_chr_val_handle ||
+           attr_handle == millivolts_chr_val_handle ||
+           attr_handle == percent_chr_val_handle ||
+           attr_handle == timestamped_chr_val_handle;
+}
+
 /* Public functions */
-void send_potentiometer_notification(void) {
-    if (potentiometer_notify_status && potentiometer_chr_conn_handle_inited) {
-        ble_gatts_notify(potentiometer_chr_conn_handle,
-                           potentiometer_chr_val_handle);
-        ESP_LOGI(TAG, "potentiometer notification sent!");
+int send_potentiometer_notification(uint16_t conn_handle, uint16_t attr_handle,
+                                    const struct potentiometer_snapshot *snapshot) {
+    /* Local variables */
+    int rc;
+    struct os_mbuf *om;
+    uint8_t payload[CHR_VALUE_MAX_LEN];
+    size_t payload_len;
+
+    /* Build the payload straight from the snapshot rather than going back
+     * through potentiometer_chr_access */
+    payload_len = encode_chr_value(attr_handle, snapshot, payload);
+    if (payload_len == 0) {
+        return BLE_HS_EINVAL;
+    }
+    om = ble_hs_mbuf_from_flat(payload, payload_len);
+    if (om == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+
+    /* The host takes ownership of om, even on failure */
+    rc = ble_gatts_notify_custom(conn_handle, attr_handle, om);
+    if (rc == 0) {
+        trace_event(TRACE_EV_NOTIFY_SENT, conn_handle, attr_handle);
     }
+    return rc;
+}
+
+int send_clock_sync_reply(uint16_t conn_handle, const struct clock_sync_reply *reply) {
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(reply, sizeof(*reply));
+    if (om == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+    /* The host takes ownership of om, even on failure */
+    return ble_gatts_notify_custom(conn_handle, sync_exchange_chr_val_handle, om);
+}
+
+int send_aggregate_notification(uint16_t conn_handle, const uint8_t *payload,
+                                size_t len) {
+#if GATEWAY_ENABLED
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(payload, len);
+    if (om == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+    /* The host takes ownership of om, even on failure */
+    return ble_gatts_notify_custom(conn_handle, aggregate_chr_val_handle, om);
+#else
+    return BLE_HS_ENOTSUP;
+#endif
 }
 
 /*
@@ -157,12 +573,18 @@ void gatt_svr_subscribe_cb(struct ble_gap_event *event) {
     }
 
     /* Check attribute handle */
-    if (event->subscribe.attr_handle == potentiometer_chr_val_handle) {
+    if (is_notify_chr(event->subscribe.attr_handle)) {
         /* Update potentiometer subscription status */
-        potentiometer_chr_conn_handle = event->subscribe.conn_handle;
-        potentiometer_chr_conn_handle_inited = true;
-        potentiometer_notify_status = event->subscribe.cur_notify;
+        notify_subscribe(event->subscribe.conn_handle,
+                         event->subscribe.attr_handle,
+                         event->subscribe.cur_notify);
+    }
+#if GATEWAY_ENABLED
+    else if (event->subscribe.attr_handle == aggregate_chr_val_handle) {
+        gateway_subscribe(event->subscribe.conn_handle,
+                          event->subscribe.cur_notify);
     }
+#endif
 }
 
 /*
@@ -14,8 +14,28 @@
 /* NimBLE GAP APIs */
 #include "host/ble_gap.h"
 
+/* Application module headers */
+#include "snapshot.h"
+
+/* Characteristics that can be subscribed to: raw ADC code, millivolts, position
+ * and the timestamped value of the time sync service */
+#define POTENTIOMETER_NOTIFY_CHR_COUNT 4
+
+struct clock_sync_reply;
+
 /* Public function declarations */
-void send_potentiometer_notification(void);
+/* Notify one connection of a potentiometer snapshot, encoded for the
+ * characteristic with value handle attr_handle. Returns the
+ * ble_gatts_notify_custom return code */
+int send_potentiometer_notification(uint16_t conn_handle, uint16_t attr_handle,
+                                    const struct potentiometer_snapshot *snapshot);
+/* Notify one connection of the reply to its time sync request (see
+ * clock_sync.h). Returns the ble_gatts_notify_custom return code */
+int send_clock_sync_reply(uint16_t conn_handle, const struct clock_sync_reply *reply);
+/* Notify one connection of a gateway aggregate batch (see gateway.h). Returns
+ * the ble_gatts_notify_custom return code */
+int send_aggregate_notification(uint16_t conn_handle, const uint8_t *payload,
+                                size_t len);
 void gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg);
 void gatt_svr_subscribe_cb(struct ble_gap_event *event);
 int gatt_svc_init(void);
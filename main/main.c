@@ -1,8 +1,8 @@
 /* Application for distributing potentiometer values through BLE 
 
 Data is read from the ADC using the ULP FSM coprocessor
-The read values are published into a queue on Core 1
-Values are dequeued by a subscriber task and sent to BLE on Core 0
+The read values are polled and filtered on Core 1 and passed through a queue
+to the GATT sink on Core 0, which publishes them to BLE (see pipeline.h)
 */
 
 /* Standard headers */
@@ -11,14 +11,22 @@ Values are dequeued by a subscriber task and sent to BLE on Core 0
 /* ESP-IDF headers */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "esp_log.h"
+#include "nvs_flash.h"
 
 /* Application module headers */
 #include "ulp_main.h"  // interface to ULP assembly file
-#include "producer.h"  // publishing service for potentiometer values
-#include "consumer.h"
-#include "ble.h"  // BLE services, including task that subscribes to the ADC data queue and updates the BLE value
+#include "pipeline.h"  // stages of the data path and how they are wired
+#include "producer.h"  // ULP source and change filter stages
+#include "consumer.h"  // GATT and log sink stages
+#include "adc_cal.h"  // calibrated millivolt and position conversion
+#include "app_config.h"  // runtime configuration, persisted in NVS
+#include "ble.h"  // BLE services, including the task that sends the published value as notifications
+#include "trace.h"  // deferred binary logging used on the hot paths
+#include "bench.h"  // optional pipeline stage benchmarks
+#include "sched_trace.h"  // optional scheduler trace capture
+#include "capture.h"  // optional ADC sample capture for host replay
+#include "clock_sync.h"  // RTC timebase of the samples and the time sync service
 
 #define MAIN_LOG_NAME "MAIN"
 
@@ -33,16 +41,57 @@ void app_main(void)
     vTaskDelay(pdMS_TO_TICKS(1000));
     ESP_LOGI(MAIN_LOG_NAME, "Starting main application\n");
 
-    QueueHandle_t ulp_value_queue = xQueueCreate(10, sizeof(uint32_t));
-    if (ulp_value_queue == NULL) {
-        ESP_LOGE(MAIN_LOG_NAME, "Failed to create queue");
+#if BENCH_ENABLED
+    /* Benchmark the pipeline stages on both cores before the pipeline starts competing for them */
+    bench_run();
+#endif
+
+    /* NVS flash initialization
+     * Holds the runtime configuration and the BLE stack's configurations between resets
+     */
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
+        ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
     }
+    ESP_ERROR_CHECK(ret);
+
+    /* Load the runtime configuration before any task reads it */
+    app_config_init();
+
+    /* Start draining hot-path trace events before any task can record them */
+    trace_init();
+
+    /* Read the ADC calibration and build the conversion table used by the GATT service */
+    adc_cal_init();
 
-    /* Start the ULP program and the task that puts values into the queue */
-    potentiometer_data_producer_init(ulp_value_queue);
+    /* Schedule a scheduler trace capture (if enabled) */
+    sched_trace_init();
 
-    /* Start the task that dequeues values and passes them to BLE */
-    potentiometer_data_consumer_init(ulp_value_queue);
+    /* Stream the ULP samples to the console for replay on the host (if enabled) */
+    capture_init();
+
+    /* Read the RTC calibration, which dates samples by their ULP stamp, before
+    the producer starts and the BLE host can take sync requests */
+    clock_sync_init();
+
+    /* Start the ULP program */
+    potentiometer_data_producer_init();
+
+    /* Wire the data path: ULP samples (captured if enabled) go through the change
+     * filter and a queue to the GATT sink, which passes them on to the log */
+    static struct pipeline_stage *const stages[] = {
+        &ulp_source_stage, &capture_sink_stage, &change_filter_stage,
+        &gatt_sink_stage, &log_sink_stage,
+    };
+    if (CAPTURE_ENABLED) {
+        pipeline_connect(&ulp_source_stage, &capture_sink_stage);
+    }
+    pipeline_connect(&ulp_source_stage, &change_filter_stage);
+    pipeline_connect(&change_filter_stage, &gatt_sink_stage);
+    pipeline_connect(&gatt_sink_stage, &log_sink_stage);
+    pipeline_start(stages, sizeof(stages) / sizeof(stages[0]));
 
     /* Start the BLE stack that advertises, connects, and notifies of new values 
     via a GATT service characteristic */
@@ -0,0 +1,465 @@
+/* Implementations for notify.h */
+
+/* Header */
+#include "notify.h"
+
+/* Includes */
+#include "app_config.h"
+#include "common.h"
+#include "esp_timer.h"
+#include "gatt_svc.h"
+#include "trace.h"
+
+/* Flow control state of one subscription */
+struct notify_conn {
+    bool active;           // Slot is in use by a subscription
+    uint16_t conn_handle;
+    uint16_t attr_handle;  // Value handle of the subscribed characteristic
+    uint8_t in_flight;     // Notifications handed to the host but not yet completed
+    uint32_t backlog_next; // Next backlog sample to replay (counted like notify_backlog.count)
+    uint32_t backlog_end;  // Backlog samples to replay end here
+    struct notify_schedule schedule;  // When samples are due, with the connection's parameters
+};
+
+/* Subscription parameters written by a connection, kept until it disconnects */
+struct notify_client {
+    bool active;
+    uint16_t conn_handle;
+    struct notify_params params;
+};
+
+/* Samples published while notifications were interrupted by a stack reset */
+struct notify_backlog {
+    struct potentiometer_snapshot samples[NOTIFY_BACKLOG_LEN];
+    uint32_t count;        // Samples recorded since the reset; the oldest are overwritten
+    uint32_t last_seq;     // Sequence number of the newest recorded sample
+    bool recording;        // From a reset until the replay window closes
+    bool synced;           // The host has synced since the reset
+    uint32_t expires_ms;   // End of the replay window
+};
+
+/* Private variables */
+static struct notify_conn notify_conns[NOTIFY_MAX_SUBSCRIPTIONS];
+static struct notify_client notify_clients[NOTIFY_MAX_CONNECTIONS];
+static struct notify_stats notify_stats;
+static uint32_t notify_period_min_ms = BLE_NOTIFICATION_PERIOD_MS;  // From the configuration
+static struct notify_backlog notify_backlog;
+static bool notify_paused;        // Between a stack reset and the following sync
+static bool notify_recovering;    // No notification sent since the last reset
+static int64_t notify_reset_us;
+/* Connection state is shared between the NimBLE host task and the notify task */
+static portMUX_TYPE notify_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Private functions */
+/* Clock of the subscription schedules */
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/* Must be called with notify_lock held */
+static struct notify_conn *find_conn(uint16_t conn_handle, uint16_t attr_handle) {
+    for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+        if (notify_conns[i].active && notify_conns[i].conn_handle == conn_handle &&
+            notify_conns[i].attr_handle == attr_handle) {
+            return &notify_conns[i];
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with notify_lock held */
+static struct notify_client *find_client(uint16_t conn_handle) {
+    for (int i = 0; i < NOTIFY_MAX_CONNECTIONS; i++) {
+        if (notify_clients[i].active && notify_clients[i].conn_handle == conn_handle) {
+            return &notify_clients[i];
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with notify_lock held */
+static void release_conn(struct notify_conn *conn) {
+    notify_stats.queue_depth -= conn->in_flight;
+    notify_stats.subscribers--;
+    memset(conn, 0, sizeof(*conn));
+}
+
+/* Account for the delivery latency of a sample the subscription had not seen yet.
+ * Must be called with notify_lock held
+ */
+static void record_latency(const struct potentiometer_snapshot *sent, int64_t now_us) {
+    uint32_t latency_us = (uint32_t)(now_us - sent->timestamp_us);
+    if (notify_stats.latency_count == 0 || latency_us < notify_stats.latency_min_us) {
+        notify_stats.latency_min_us = latency_us;
+    }
+    if (latency_us > notify_stats.latency_max_us) {
+        notify_stats.latency_max_us = latency_us;
+    }
+    notify_stats.latency_total_us += latency_us;
+    notify_stats.latency_count++;
+}
+
+/* Must be called with notify_lock held */
+static void drop_pending(struct notify_conn *conn, int reason) {
+    notify_stats.drops++;
+    notify_schedule_drop(&conn->schedule);
+    trace_event(TRACE_EV_NOTIFY_DROPPED, conn->conn_handle, (uint32_t)reason);
+}
+
+/* The pending sample could not be sent because the link is congested.
+ * Must be called with notify_lock held
+ */
+static void hold_back(struct notify_conn *conn, int reason) {
+    bool backed_off;
+
+    notify_stats.retries++;
+    bool drop = notify_schedule_hold_back(&conn->schedule, &backed_off);
+    if (backed_off) {
+        trace_event(TRACE_EV_NOTIFY_BACKOFF, conn->conn_handle, conn->schedule.period_ms);
+    }
+    if (drop) {
+        drop_pending(conn, reason);
+    }
+}
+
+/* Oldest backlog sample that has not been overwritten. Must be called with notify_lock held */
+static uint32_t backlog_first(void) {
+    return (notify_backlog.count > NOTIFY_BACKLOG_LEN) ? notify_backlog.count - NOTIFY_BACKLOG_LEN : 0;
+}
+
+/* True if the subscription still has backlog samples to send. Must be called with notify_lock held */
+static bool replaying(struct notify_conn *conn) {
+    if (conn->backlog_next < backlog_first()) {
+        conn->backlog_next = backlog_first();
+    }
+    return conn->backlog_next < conn->backlog_end;
+}
+
+/* Record a new sample while notifications are interrupted */
+static void record_backlog(void) {
+    struct potentiometer_snapshot current;
+
+    snapshot_read(&current);
+    portENTER_CRITICAL(&notify_lock);
+    if (notify_backlog.recording && (current.flags & POTENTIOMETER_FLAG_VALID) &&
+        current.seq != notify_backlog.last_seq) {
+        notify_backlog.samples[notify_backlog.count % NOTIFY_BACKLOG_LEN] = current;
+        notify_backlog.count++;
+        notify_backlog.last_seq = current.seq;
+    }
+    portEXIT_CRITICAL(&notify_lock);
+}
+
+/* Public functions */
+void notify_subscribe(uint16_t conn_handle, uint16_t attr_handle, bool enabled) {
+    /* Local variables */
+    struct notify_conn *conn;
+    struct potentiometer_snapshot current;
+    struct notify_params params = {0};
+    bool no_slot = false;
+    uint32_t now = now_ms();
+
+    /* Only samples published after subscribing count towards delivery latency */
+    snapshot_read(&current);
+
+    portENTER_CRITICAL(&notify_lock);
+    conn = find_conn(conn_handle, attr_handle);
+    struct notify_client *client = find_client(conn_handle);
+    if (!enabled) {
+        if (conn != NULL) {
+            release_conn(conn);
+        }
+    } else if (conn == NULL) {
+        no_slot = true;
+        for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+            if (!notify_conns[i].active) {
+                conn = &notify_conns[i];
+                conn->active = true;
+                conn->conn_handle = conn_handle;
+                conn->attr_handle = attr_handle;
+                if (client != NULL) {
+                    params = client->params;
+                }
+                notify_schedule_start(&conn->schedule, &params, notify_period_min_ms, current.seq, now);
+                /* Catch up on what was missed during a stack reset */
+                if (notify_backlog.recording) {
+                    conn->backlog_next = backlog_first();
+                    conn->backlog_end = notify_backlog.count;
+                }
+                notify_stats.subscribers++;
+                no_slot = false;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&notify_lock);
+
+    if (no_slot) {
+        ESP_LOGE(TAG, "no notify slot left for conn_handle=%d attr_handle=%d",
+                 conn_handle, attr_handle);
+    }
+}
+
+bool notify_set_params(uint16_t conn_handle, const struct notify_params *params) {
+    /* Local variables */
+    struct notify_client *client;
+    uint32_t now = now_ms();
+
+    if (!notify_params_valid(params)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&notify_lock);
+    client = find_client(conn_handle);
+    for (int i = 0; client == NULL && i < NOTIFY_MAX_CONNECTIONS; i++) {
+        if (!notify_clients[i].active) {
+            client = &notify_clients[i];
+            client->active = true;
+            client->conn_handle = conn_handle;
+        }
+    }
+    if (client != NULL) {
+        client->params = *params;
+        /* Apply to the current subscriptions straight away */
+        for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+            struct notify_conn *conn = &notify_conns[i];
+            if (conn->active && conn->conn_handle == conn_handle) {
+                notify_schedule_set_params(&conn->schedule, params, notify_period_min_ms, now);
+            }
+        }
+    }
+    portEXIT_CRITICAL(&notify_lock);
+    return client != NULL;
+}
+
+void notify_get_params(uint16_t conn_handle, struct notify_params *params) {
+    portENTER_CRITICAL(&notify_lock);
+    struct notify_client *client = find_client(conn_handle);
+    if (client != NULL) {
+        *params = client->params;
+    } else {
+        memset(params, 0, sizeof(*params));
+    }
+    portEXIT_CRITICAL(&notify_lock);
+}
+
+void notify_disconnect(uint16_t conn_handle) {
+    portENTER_CRITICAL(&notify_lock);
+    for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+        if (notify_conns[i].active && notify_conns[i].conn_handle == conn_handle) {
+            release_conn(&notify_conns[i]);
+        }
+    }
+    struct notify_client *client = find_client(conn_handle);
+    if (client != NULL) {
+        memset(client, 0, sizeof(*client));
+    }
+    portEXIT_CRITICAL(&notify_lock);
+}
+
+void notify_stack_reset(int reason) {
+    portENTER_CRITICAL(&notify_lock);
+    for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+        if (notify_conns[i].active) {
+            release_conn(&notify_conns[i]);
+        }
+    }
+    memset(notify_clients, 0, sizeof(notify_clients));
+    notify_stats.resets++;
+    notify_paused = true;
+    notify_recovering = true;
+    notify_reset_us = esp_timer_get_time();
+    /* Keep the backlog of an earlier reset that hasn't been replayed yet */
+    if (!notify_backlog.recording) {
+        notify_backlog.count = 0;
+        notify_backlog.recording = true;
+    }
+    notify_backlog.synced = false;
+    portEXIT_CRITICAL(&notify_lock);
+
+    trace_event(TRACE_EV_STACK_RESET, (uint32_t)reason, 0);
+}
+
+void notify_stack_synced(void) {
+    uint32_t since_reset_ms = 0;
+
+    portENTER_CRITICAL(&notify_lock);
+    if (notify_paused) {
+        since_reset_ms = (uint32_t)((esp_timer_get_time() - notify_reset_us) / 1000);
+        notify_paused = false;
+        notify_backlog.synced = true;
+        notify_backlog.expires_ms = now_ms() + NOTIFY_BACKLOG_HOLD_MS;
+    }
+    portEXIT_CRITICAL(&notify_lock);
+
+    if (since_reset_ms > 0) {
+        trace_event(TRACE_EV_STACK_SYNCED, since_reset_ms, 0);
+    }
+}
+
+void notify_tx_complete(uint16_t conn_handle, uint16_t attr_handle, int status) {
+    portENTER_CRITICAL(&notify_lock);
+    if (status == 0 || status == BLE_HS_EDONE) {
+        notify_stats.completed++;
+    } else {
+        notify_stats.failed++;
+    }
+    struct notify_conn *conn = find_conn(conn_handle, attr_handle);
+    if (conn != NULL && conn->in_flight > 0) {
+        conn->in_flight--;
+        notify_stats.queue_depth--;
+    }
+    portEXIT_CRITICAL(&notify_lock);
+}
+
+uint32_t notify_service(void) {
+    /* Local variables */
+    uint32_t now = now_ms();
+    struct app_config config;
+    uint32_t wait;
+    struct potentiometer_snapshot current;
+    /* Sampled once per pass; the pool only shrinks further as we send */
+    bool mbufs_available = os_msys_num_free() >= NOTIFY_MIN_FREE_MBUFS;
+
+    /* Every subscription is evaluated against the same snapshot */
+    snapshot_read(&current);
+
+    /* Pick up a new notify period; connections faster than it slow down at once
+     * and those slower catch up through the normal recovery */
+    app_config_get(&config);
+    wait = config.notify_period_ms;
+    portENTER_CRITICAL(&notify_lock);
+    notify_period_min_ms = config.notify_period_ms;
+    for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+        if (notify_conns[i].active) {
+            notify_schedule_set_period(&notify_conns[i].schedule, notify_period_min_ms);
+        }
+    }
+    /* Close the replay window of the last reset */
+    if (notify_backlog.recording && notify_backlog.synced &&
+        (int32_t)(now - notify_backlog.expires_ms) >= 0) {
+        notify_backlog.recording = false;
+        for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+            notify_conns[i].backlog_next = notify_conns[i].backlog_end = 0;
+        }
+    }
+    bool recording = notify_backlog.recording;
+    bool paused = notify_paused;
+    portEXIT_CRITICAL(&notify_lock);
+
+    /* Keep buffering samples until the stack has recovered */
+    if (recording) {
+        record_backlog();
+        if (wait > NOTIFY_BACKLOG_POLL_MS) {
+            wait = NOTIFY_BACKLOG_POLL_MS;
+        }
+    }
+    if (paused) {
+        return wait;
+    }
+
+    for (int i = 0; i < NOTIFY_MAX_SUBSCRIPTIONS; i++) {
+        struct notify_conn *conn = &notify_conns[i];
+        uint16_t conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        uint16_t attr_handle = 0;
+        bool send = false;
+        bool from_backlog = false;
+        int rc;
+        struct potentiometer_snapshot sent;
+        int64_t sent_us;
+
+        portENTER_CRITICAL(&notify_lock);
+        if (conn->active) {
+            /* Once the period has passed, a new sample is due if the subscription
+             * wants it; with one already pending the two are coalesced */
+            if (notify_schedule_update(&conn->schedule, &current, now)) {
+                notify_stats.coalesced++;
+            }
+
+            /* Backlog samples go first, as fast as the window allows */
+            from_backlog = replaying(conn);
+            if (conn->schedule.pending || from_backlog) {
+                if (conn->in_flight < NOTIFY_MAX_IN_FLIGHT && mbufs_available) {
+                    conn->in_flight++;
+                    if (++notify_stats.queue_depth > notify_stats.max_queue_depth) {
+                        notify_stats.max_queue_depth = notify_stats.queue_depth;
+                    }
+                    conn_handle = conn->conn_handle;
+                    attr_handle = conn->attr_handle;
+                    if (from_backlog) {
+                        sent = notify_backlog.samples[conn->backlog_next % NOTIFY_BACKLOG_LEN];
+                    }
+                    send = true;
+                } else if (!from_backlog) {
+                    hold_back(conn, BLE_HS_EBUSY);
+                }
+            }
+        }
+        portEXIT_CRITICAL(&notify_lock);
+
+        /* The host may report NOTIFY_TX from inside this call, so it runs unlocked */
+        if (send) {
+            if (!from_backlog) {
+                snapshot_read(&sent);
+            }
+            rc = send_potentiometer_notification(conn_handle, attr_handle, &sent);
+            sent_us = esp_timer_get_time();
+
+            portENTER_CRITICAL(&notify_lock);
+            /* The subscription may have gone away while we were sending */
+            if (conn->active && conn->conn_handle == conn_handle &&
+                conn->attr_handle == attr_handle) {
+                if (rc == 0 && from_backlog) {
+                    notify_stats.sent++;
+                    notify_stats.replayed++;
+                    conn->backlog_next++;
+                } else if (rc == 0) {
+                    notify_stats.sent++;
+                    if (notify_schedule_sent(&conn->schedule, &sent, now)) {
+                        record_latency(&sent, sent_us);
+                    }
+                } else if (from_backlog) {
+                    /* Retry on congestion, skip the sample on other errors */
+                    if (rc != BLE_HS_ENOMEM && rc != BLE_HS_EBUSY) {
+                        conn->backlog_next++;
+                    }
+                } else if (rc == BLE_HS_ENOMEM || rc == BLE_HS_EBUSY) {
+                    hold_back(conn, rc);
+                } else {
+                    drop_pending(conn, rc);
+                }
+            }
+            /* Time from the last stack reset to notifications flowing again */
+            uint32_t recovery_us = 0;
+            uint32_t resets = notify_stats.resets;
+            if (rc == 0 && notify_recovering) {
+                notify_recovering = false;
+                recovery_us = (uint32_t)(sent_us - notify_reset_us);
+                notify_stats.recovery_last_us = recovery_us;
+                if (recovery_us > notify_stats.recovery_max_us) {
+                    notify_stats.recovery_max_us = recovery_us;
+                }
+            }
+            portEXIT_CRITICAL(&notify_lock);
+
+            if (recovery_us > 0) {
+                trace_event(TRACE_EV_STACK_RECOVERED, recovery_us / 1000, resets);
+            }
+        }
+
+        /* Work out how long the notify task can sleep */
+        portENTER_CRITICAL(&notify_lock);
+        if (conn->active) {
+            wait = replaying(conn) ? 0 : notify_schedule_wait_ms(&conn->schedule, now, wait);
+        }
+        portEXIT_CRITICAL(&notify_lock);
+    }
+
+    return wait;
+}
+
+void notify_get_stats(struct notify_stats *stats) {
+    portENTER_CRITICAL(&notify_lock);
+    *stats = notify_stats;
+    portEXIT_CRITICAL(&notify_lock);
+}
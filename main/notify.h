@@ -0,0 +1,99 @@
+/* Flow-controlled sender for potentiometer notifications
+
+Tracks every subscription (a connection subscribed to one of the potentiometer
+characteristics) separately. A notification is only handed to
+the NimBLE host when the connection has room in its in-flight window (completions
+are reported through BLE_GAP_EVENT_NOTIFY_TX) and the mbuf pool has headroom.
+When the link is congested the pending sample is either held back and coalesced
+with newer ones or dropped, depending on NOTIFY_CONGESTION_POLICY, and the
+connection's notify period backs off until the link keeps up again.
+
+When the NimBLE stack resets, every subscription is forgotten and sending pauses
+until the host has synced with the controller again. Samples published in the
+meantime are kept in a backlog, which is replayed in order to each subscription
+made within NOTIFY_BACKLOG_HOLD_MS of the sync before normal updates resume.
+
+Each connection can shape its own stream with struct notify_params (written
+through the FFF4 characteristic): a minimum interval between notifications, a
+heartbeat after which the latest value is repeated even if it hasn't changed,
+and a deadband the value must move by, relative to the last value notified,
+before it is sent. All subscriptions are evaluated against the same published
+snapshot, so slow subscribers cost no air time and don't hold back fast ones.
+When a subscription is due, and how its rate backs off, is decided by
+notify_schedule.h.
+*/
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "sdkconfig.h"
+#include "ble.h"
+#include "gatt_svc.h"
+#include "notify_schedule.h"
+
+#define NOTIFY_MAX_CONNECTIONS   CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define NOTIFY_MAX_SUBSCRIPTIONS (NOTIFY_MAX_CONNECTIONS * POTENTIOMETER_NOTIFY_CHR_COUNT)
+#define NOTIFY_MAX_IN_FLIGHT     2   // Notifications per subscription awaiting NOTIFY_TX
+#define NOTIFY_MIN_FREE_MBUFS    4   // Hold back when fewer mbufs than this are free
+#define NOTIFY_BACKLOG_LEN       32     // Samples kept while a stack reset interrupts notifications
+#define NOTIFY_BACKLOG_POLL_MS   20     // How often new samples are picked up for the backlog
+#define NOTIFY_BACKLOG_HOLD_MS   30000  // How long after the sync the backlog is replayed to new subscriptions
+
+/* Counters across all connections */
+struct notify_stats {
+    uint32_t sent;            // Notifications accepted by the host
+    uint32_t completed;       // NOTIFY_TX completions with success status
+    uint32_t failed;          // NOTIFY_TX completions with error status
+    uint32_t retries;         // Sends that were held back or retried
+    uint32_t coalesced;       // Samples merged into an already pending one
+    uint32_t drops;           // Samples discarded
+    uint32_t queue_depth;     // Notifications currently in flight
+    uint32_t max_queue_depth; // High water mark of queue_depth
+    uint32_t subscribers;     // Subscriptions currently active
+    /* Delivery latency of new samples, from capture by the producer to the
+     * first notification accepted for each subscription */
+    uint32_t latency_count;
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint64_t latency_total_us;
+    /* Recovery from NimBLE stack resets */
+    uint32_t resets;
+    uint32_t replayed;           // Backlog samples sent after a reset
+    uint32_t recovery_last_us;   // From the last reset to the first notification after it
+    uint32_t recovery_max_us;
+};
+
+/* Record a change in notification subscription of a connection to the
+ * characteristic with value handle attr_handle */
+void notify_subscribe(uint16_t conn_handle, uint16_t attr_handle, bool enabled);
+
+/* Validate and apply the subscription parameters of a connection, to its current
+ * and future subscriptions. Returns false, leaving the current ones in place, if
+ * params is out of range */
+bool notify_set_params(uint16_t conn_handle, const struct notify_params *params);
+
+/* Copy the subscription parameters of a connection */
+void notify_get_params(uint16_t conn_handle, struct notify_params *params);
+
+/* Forget all subscriptions and parameters of a connection */
+void notify_disconnect(uint16_t conn_handle);
+
+/* The NimBLE host reset: forget all subscriptions and parameters and pause until notify_stack_synced */
+void notify_stack_reset(int reason);
+
+/* The NimBLE host synced with the controller again */
+void notify_stack_synced(void);
+
+/* Handle a BLE_GAP_EVENT_NOTIFY_TX completion */
+void notify_tx_complete(uint16_t conn_handle, uint16_t attr_handle, int status);
+
+/* Send notifications that are due. Returns the number of ms until the next one is due,
+ * 0 if a replay of the backlog is waiting for room in a window */
+uint32_t notify_service(void);
+
+/* Copy the current counters */
+void notify_get_stats(struct notify_stats *stats);
+
+#endif // NOTIFY_H
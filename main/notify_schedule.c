@@ -0,0 +1,174 @@
+/* Implementations for notify_schedule.h */
+
+/* Header */
+#include "notify_schedule.h"
+
+/* Standard headers */
+#include <string.h>
+
+_Static_assert(sizeof(struct notify_params) == 6, "notify_params must not contain padding");
+
+/* Private functions */
+static uint32_t min_period_ms(const struct notify_params *params, uint32_t notify_period_ms) {
+    return params->min_interval_ms ? params->min_interval_ms : notify_period_ms;
+}
+
+/* Longest time without a notification, 0 for none. Never shorter than the
+ * current period, so it can't undo a back off */
+static uint32_t heartbeat_ms(const struct notify_schedule *schedule) {
+    uint32_t heartbeat;
+
+    if (schedule->params.max_interval_ms == NOTIFY_HEARTBEAT_OFF) {
+        return 0;
+    }
+    heartbeat = schedule->params.max_interval_ms ? schedule->params.max_interval_ms
+                                                 : schedule->min_period_ms;
+    return (heartbeat > schedule->period_ms) ? heartbeat : schedule->period_ms;
+}
+
+/* True if the subscription should be sent the current snapshot */
+static bool wants_sample(const struct notify_schedule *schedule,
+                         const struct potentiometer_snapshot *current, uint32_t now_ms) {
+    uint32_t heartbeat = heartbeat_ms(schedule);
+
+    if (!schedule->sent_any) {
+        return true;
+    }
+    if (heartbeat > 0 && now_ms - schedule->last_sent_ms >= heartbeat) {
+        return true;
+    }
+    if (!(current->flags & POTENTIOMETER_FLAG_VALID) || current->seq == schedule->last_seq) {
+        return false;
+    }
+    uint32_t diff = (current->value > schedule->last_value) ? current->value - schedule->last_value
+                                                            : schedule->last_value - current->value;
+    return diff > schedule->params.deadband;
+}
+
+/* Halve the notify rate of a congested subscription */
+static void back_off(struct notify_schedule *schedule) {
+    schedule->clean_sends = 0;
+    schedule->period_ms *= 2;
+    if (schedule->period_ms > NOTIFY_BACKOFF_LIMIT * schedule->min_period_ms) {
+        schedule->period_ms = NOTIFY_BACKOFF_LIMIT * schedule->min_period_ms;
+    }
+}
+
+/* Step the notify rate back up once the link has kept up for a while */
+static void recover(struct notify_schedule *schedule) {
+    if (++schedule->clean_sends < NOTIFY_RECOVERY_SENDS) {
+        return;
+    }
+    schedule->clean_sends = 0;
+    if (schedule->period_ms > schedule->min_period_ms + NOTIFY_PERIOD_STEP_MS) {
+        schedule->period_ms -= NOTIFY_PERIOD_STEP_MS;
+    } else {
+        schedule->period_ms = schedule->min_period_ms;
+    }
+}
+
+/* Public functions */
+bool notify_params_valid(const struct notify_params *params) {
+    uint16_t min_interval = params->min_interval_ms;
+    uint16_t max_interval = params->max_interval_ms;
+
+    /* 0 selects the default for both intervals */
+    if (min_interval != 0 &&
+        (min_interval < NOTIFY_INTERVAL_MIN_MS || min_interval > NOTIFY_INTERVAL_MAX_MS)) {
+        return false;
+    }
+    if (max_interval != 0 && max_interval != NOTIFY_HEARTBEAT_OFF &&
+        (max_interval > NOTIFY_HEARTBEAT_MAX_MS || max_interval < min_interval ||
+         max_interval < NOTIFY_INTERVAL_MIN_MS)) {
+        return false;
+    }
+    return params->deadband <= NOTIFY_DEADBAND_MAX;
+}
+
+void notify_schedule_start(struct notify_schedule *schedule, const struct notify_params *params,
+                           uint32_t notify_period_ms, uint32_t seq, uint32_t now_ms) {
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->last_seq = seq;
+    notify_schedule_set_params(schedule, params, notify_period_ms, now_ms);
+}
+
+void notify_schedule_set_params(struct notify_schedule *schedule, const struct notify_params *params,
+                                uint32_t notify_period_ms, uint32_t now_ms) {
+    schedule->params = *params;
+    schedule->min_period_ms = min_period_ms(params, notify_period_ms);
+    schedule->period_ms = schedule->min_period_ms;
+    schedule->clean_sends = 0;
+    schedule->next_due_ms = now_ms;
+}
+
+void notify_schedule_set_period(struct notify_schedule *schedule, uint32_t notify_period_ms) {
+    schedule->min_period_ms = min_period_ms(&schedule->params, notify_period_ms);
+    if (schedule->period_ms < schedule->min_period_ms) {
+        schedule->period_ms = schedule->min_period_ms;
+    }
+}
+
+bool notify_schedule_update(struct notify_schedule *schedule,
+                            const struct potentiometer_snapshot *current, uint32_t now_ms) {
+    if ((int32_t)(now_ms - schedule->next_due_ms) < 0 || !wants_sample(schedule, current, now_ms)) {
+        return false;
+    }
+    bool coalesced = schedule->pending;
+    schedule->next_due_ms = now_ms + schedule->period_ms;
+    schedule->pending = true;
+    return coalesced;
+}
+
+bool notify_schedule_sent(struct notify_schedule *schedule,
+                          const struct potentiometer_snapshot *sent, uint32_t now_ms) {
+    bool fresh = (sent->flags & POTENTIOMETER_FLAG_VALID) && sent->seq != schedule->last_seq;
+
+    schedule->pending = false;
+    schedule->attempts = 0;
+    schedule->sent_any = true;
+    schedule->last_value = sent->value;
+    schedule->last_sent_ms = now_ms;
+    if (fresh) {
+        schedule->last_seq = sent->seq;
+    }
+    recover(schedule);
+    return fresh;
+}
+
+bool notify_schedule_hold_back(struct notify_schedule *schedule, bool *backed_off) {
+    /* Back off once per sample rather than on every retry */
+    *backed_off = schedule->attempts++ == 0;
+    if (*backed_off) {
+        back_off(schedule);
+    }
+    return NOTIFY_CONGESTION_POLICY == NOTIFY_POLICY_DROP ||
+           schedule->attempts >= NOTIFY_MAX_RETRIES;
+}
+
+void notify_schedule_drop(struct notify_schedule *schedule) {
+    schedule->pending = false;
+    schedule->attempts = 0;
+}
+
+uint32_t notify_schedule_wait_ms(const struct notify_schedule *schedule, uint32_t now_ms,
+                                 uint32_t idle_ms) {
+    int32_t until_due = (int32_t)(schedule->next_due_ms - now_ms);
+    uint32_t wait = (until_due > 0) ? (uint32_t)until_due : 0;
+
+    if (schedule->pending && wait > NOTIFY_RETRY_MS) {
+        wait = NOTIFY_RETRY_MS;
+    } else if (!schedule->pending && wait == 0) {
+        /* Due, but the value hasn't moved past the deadband: sleep until the
+         * heartbeat, or until a new sample wakes the notifier */
+        uint32_t heartbeat = heartbeat_ms(schedule);
+        uint32_t since_sent = now_ms - schedule->last_sent_ms;
+        wait = idle_ms;
+        if (heartbeat > 0) {
+            uint32_t left = (since_sent < heartbeat) ? heartbeat - since_sent : 0;
+            if (left < wait) {
+                wait = left;
+            }
+        }
+    }
+    return (wait < idle_ms) ? wait : idle_ms;
+}
@@ -0,0 +1,106 @@
+/* Notification schedule of one subscription
+
+Decides when a subscription is sent the published snapshot (see notify.h): once
+its current period has passed, if nothing was sent since it subscribed, the
+value moved by more than its deadband since the last notification, or its
+heartbeat is due. It also adapts the period to the link, doubling it when a
+sample has to be held back and stepping it back down after a run of clean sends,
+and works out how long the notifier can sleep before the subscription needs it.
+
+Times are in milliseconds on a free-running 32-bit clock that may wrap.
+
+These functions have no ESP-IDF dependencies so they also build on the host
+(see bench/host/replay_host.c).
+*/
+#ifndef NOTIFY_SCHEDULE_H
+#define NOTIFY_SCHEDULE_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "snapshot.h"
+
+/* Congestion policies */
+#define NOTIFY_POLICY_COALESCE 0  // Keep the sample pending and send the latest value once the link frees up
+#define NOTIFY_POLICY_DROP     1  // Discard the sample and wait for the next period
+
+#define NOTIFY_CONGESTION_POLICY NOTIFY_POLICY_COALESCE
+#define NOTIFY_MAX_RETRIES       3   // Attempts for one sample before it is dropped
+/* The fastest rate, used while the link keeps up, is the subscription's minimum
+ * interval or the configured notify period (see app_config.h) */
+#define NOTIFY_BACKOFF_LIMIT     8   // Slowest rate under sustained congestion, as a multiple of the fastest
+#define NOTIFY_PERIOD_STEP_MS    50  // Period decrease after NOTIFY_RECOVERY_SENDS clean sends
+#define NOTIFY_RECOVERY_SENDS    4
+#define NOTIFY_RETRY_MS          50  // How soon a held back sample is attempted again
+
+/* Limits enforced on struct notify_params */
+#define NOTIFY_INTERVAL_MIN_MS   20     // Fastest minimum interval a connection may ask for
+#define NOTIFY_INTERVAL_MAX_MS   10000  // Slowest minimum interval
+#define NOTIFY_HEARTBEAT_MAX_MS  60000
+#define NOTIFY_HEARTBEAT_OFF     0xFFFF // max_interval_ms value: only notify on change
+#define NOTIFY_DEADBAND_MAX      4095   // Full ADC range
+
+/* Subscription parameters of one connection, sent over BLE as is (little-endian,
+ * laid out without padding). All zero until the connection writes its own */
+struct notify_params {
+    uint16_t min_interval_ms;  // Shortest time between notifications, 0 for the configured notify period
+    uint16_t max_interval_ms;  // Heartbeat, 0 for the minimum interval, NOTIFY_HEARTBEAT_OFF for none
+    uint16_t deadband;         // Change in ADC code needed to notify a new value, 0 for any change
+};
+
+/* Schedule state of one subscription */
+struct notify_schedule {
+    struct notify_params params;
+    uint32_t min_period_ms;  // Fastest period: params.min_interval_ms or the configured notify period
+    uint32_t period_ms;      // Current (adaptive) period
+    uint32_t next_due_ms;    // When the next sample is due
+    uint32_t last_sent_ms;   // When the last notification was accepted
+    uint32_t last_seq;       // Snapshot sequence number last delivered
+    uint16_t last_value;     // ADC code last notified, the deadband is relative to it
+    bool sent_any;           // A notification was accepted since subscribing
+    bool pending;            // A sample is waiting to be sent
+    uint8_t attempts;        // Failed attempts for the pending sample
+    uint8_t clean_sends;     // Consecutive sends without congestion
+};
+
+/* True if every field of params is in range */
+bool notify_params_valid(const struct notify_params *params);
+
+/* Start a subscription at now_ms. Snapshots up to sequence number seq count as delivered */
+void notify_schedule_start(struct notify_schedule *schedule, const struct notify_params *params,
+                           uint32_t notify_period_ms, uint32_t seq, uint32_t now_ms);
+
+/* Apply new subscription parameters; the next sample is due at once */
+void notify_schedule_set_params(struct notify_schedule *schedule, const struct notify_params *params,
+                                uint32_t notify_period_ms, uint32_t now_ms);
+
+/* Pick up the configured notify period. A subscription faster than its new
+ * fastest period slows down at once; a slower one catches up through the normal recovery */
+void notify_schedule_set_period(struct notify_schedule *schedule, uint32_t notify_period_ms);
+
+/* Once the period has passed, mark current pending if the subscription wants it.
+ * Returns true if it replaced a sample that was still pending (coalesced) */
+bool notify_schedule_update(struct notify_schedule *schedule,
+                            const struct potentiometer_snapshot *current, uint32_t now_ms);
+
+/* The pending sample, sent, was accepted at now_ms. Returns true if the
+ * subscription had not been sent that snapshot before, so it counts towards
+ * delivery latency */
+bool notify_schedule_sent(struct notify_schedule *schedule,
+                          const struct potentiometer_snapshot *sent, uint32_t now_ms);
+
+/* The pending sample could not be sent because the link is congested. Backs off
+ * once per sample and sets *backed_off if it did. Returns true if the sample has
+ * to be dropped (see notify_schedule_drop) */
+bool notify_schedule_hold_back(struct notify_schedule *schedule, bool *backed_off);
+
+/* Discard the pending sample */
+void notify_schedule_drop(struct notify_schedule *schedule);
+
+/* Time from now_ms until the subscription needs the notifier again: the next
+ * period, a retry of the pending sample, or its heartbeat. idle_ms is returned if
+ * nothing is due before it; a new sample wakes the notifier anyway */
+uint32_t notify_schedule_wait_ms(const struct notify_schedule *schedule, uint32_t now_ms,
+                                 uint32_t idle_ms);
+
+#endif // NOTIFY_SCHEDULE_H
@@ -0,0 +1,210 @@
+/* Implementations for pipeline.h, and the platform hooks of pipeline_graph.h */
+
+/* Header */
+#include "pipeline.h"
+
+#if PIPELINE_STATS_PERIOD_MS > 0
+/* Compile ESP_LOGI in for this file so the stage statistics can be enabled on
+ * their own (see pipeline_stats_task); the other Info lines stay filtered at run time */
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#endif
+
+/* Standard headers */
+#include <assert.h>
+
+/* ESP-IDF headers */
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/* Application module headers */
+#include "sched_trace.h"
+#include "trace.h"
+
+#define PIPELINE_LOG_NAME "PIPELINE"
+#define PIPELINE_STATS_LOG_NAME "PIPELINE_STATS"
+
+/* Private variables */
+static struct pipeline_batch pipeline_pool[PIPELINE_POOL_LEN];
+static QueueHandle_t pipeline_free;  // Batches not owned by any stage
+static StaticQueue_t pipeline_free_buffer;
+static uint8_t pipeline_free_storage[PIPELINE_POOL_LEN * sizeof(struct pipeline_batch *)];
+/* Input queues, by position in the stage list */
+static StaticQueue_t pipeline_input_buffers[PIPELINE_MAX_STAGES];
+static uint8_t pipeline_input_storage[PIPELINE_MAX_STAGES][PIPELINE_MAX_QUEUE_LEN * sizeof(struct pipeline_batch *)];
+static struct pipeline_stage *pipeline_stages[PIPELINE_MAX_STAGES];
+static int pipeline_stage_count;
+/* Counters are written by the task running a stage and read by the report */
+static portMUX_TYPE pipeline_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/* Platform hooks */
+struct pipeline_batch *pipeline_port_acquire(void)
+{
+    struct pipeline_batch *batch;
+    return (xQueueReceive(pipeline_free, &batch, 0) == pdPASS) ? batch : NULL;
+}
+
+
+void pipeline_port_release(struct pipeline_batch *batch)
+{
+    xQueueSend(pipeline_free, &batch, 0);
+}
+
+
+bool pipeline_port_send(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    if (xQueueSend(stage->input, &batch, 0) == pdPASS) {
+        return true;
+    }
+    trace_event(TRACE_EV_QUEUE_FULL, batch->samples[batch->count - 1].value, 0);
+    return false;
+}
+
+
+struct pipeline_batch *pipeline_port_receive(struct pipeline_stage *stage)
+{
+    struct pipeline_batch *batch;
+    return (xQueueReceive(stage->input, &batch, 0) == pdPASS) ? batch : NULL;
+}
+
+
+uint32_t pipeline_port_cycles(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+
+uint32_t pipeline_port_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+
+void pipeline_port_lock(void)
+{
+    portENTER_CRITICAL(&pipeline_stats_lock);
+}
+
+
+void pipeline_port_unlock(void)
+{
+    portEXIT_CRITICAL(&pipeline_stats_lock);
+}
+
+
+/* Private functions */
+/* Task of a source stage: poll at the stage's period */
+static void source_task(void *pvParameters)
+{
+    struct pipeline_stage *stage = pvParameters;
+    uint32_t period_ms = stage->period_ms(stage);
+
+    while (true) {
+        TickType_t period_ticks = pdMS_TO_TICKS(period_ms);
+        vTaskDelay(period_ticks > 0 ? period_ticks : 1);
+        /* The period after this poll decides whether a partly filled batch can wait for the next one */
+        period_ms = stage->period_ms(stage);
+        pipeline_poll(stage, period_ms);
+    }
+}
+
+
+/* Task of a queued stage: wait for a batch, drain the input queue, then pause for the stage's period */
+static void queued_task(void *pvParameters)
+{
+    struct pipeline_stage *stage = pvParameters;
+    struct pipeline_batch *batch;
+
+    while (true) {
+        if (xQueueReceive(stage->input, &batch, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        uint32_t pause_ms = pipeline_drain(stage, batch);
+        if (pause_ms > 0) {
+            vTaskDelay(pdMS_TO_TICKS(pause_ms));
+        }
+    }
+}
+
+
+#if PIPELINE_STATS_PERIOD_MS > 0
+/* Periodically log the counters of every stage */
+static void pipeline_stats_task(void *pvParameters)
+{
+    struct pipeline_stage_stats stats;
+
+    /* Printed whatever the default log level */
+    esp_log_level_set(PIPELINE_STATS_LOG_NAME, ESP_LOG_INFO);
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(PIPELINE_STATS_PERIOD_MS));
+        for (int i = 0; i < pipeline_stage_count; i++) {
+            const struct pipeline_stage *stage = pipeline_stages[i];
+            pipeline_get_stats(stage, &stats);
+            ESP_LOGI(PIPELINE_STATS_LOG_NAME,
+                     "stage %s: batches=%" PRIu32 " items=%" PRIu32 " drops=%" PRIu32
+                     " cycles/batch=%" PRIu32,
+                     stage->name, stats.batches, stats.items, stats.drops,
+                     stats.batches ? (uint32_t)(stats.cycles / stats.batches) : 0);
+        }
+    }
+}
+#endif
+
+
+/* Public functions */
+void pipeline_start(struct pipeline_stage *const *stages, int count)
+{
+    assert(count <= PIPELINE_MAX_STAGES);
+
+    pipeline_free = xQueueCreateStatic(PIPELINE_POOL_LEN, sizeof(struct pipeline_batch *),
+                                       pipeline_free_storage, &pipeline_free_buffer);
+    for (int i = 0; i < PIPELINE_POOL_LEN; i++) {
+        pipeline_port_release(&pipeline_pool[i]);
+    }
+
+    /* Queues first, so no batch can reach a stage that isn't ready */
+    for (int i = 0; i < count; i++) {
+        struct pipeline_stage *stage = stages[i];
+        pipeline_stages[i] = stage;
+        if (stage->queue_len > 0) {
+            assert(stage->queue_len <= PIPELINE_MAX_QUEUE_LEN);
+            QueueHandle_t input = xQueueCreateStatic(stage->queue_len, sizeof(struct pipeline_batch *),
+                                                     pipeline_input_storage[i], &pipeline_input_buffers[i]);
+            stage->input = input;
+            sched_trace_watch_queue(input, stage->name);
+        }
+    }
+    pipeline_stage_count = count;
+
+    for (int i = 0; i < count; i++) {
+        struct pipeline_stage *stage = stages[i];
+        if (stage->source != NULL || stage->queue_len > 0) {
+            /* Let the task name identify the stage in scheduler traces */
+            xTaskCreatePinnedToCore(
+                stage->source != NULL ? source_task : queued_task,
+                stage->name,
+                stage->stack_size,
+                stage,
+                stage->priority,
+                NULL,
+                stage->core
+            );
+        }
+        if (stage->source != NULL || stage->queue_len > 0) {
+            ESP_LOGI(PIPELINE_LOG_NAME, "stage %s: %s on core %d, priority %d",
+                     stage->name, stage->source != NULL ? "source" : "queued",
+                     stage->core, stage->priority);
+        } else {
+            ESP_LOGI(PIPELINE_LOG_NAME, "stage %s: inline", stage->name);
+        }
+    }
+
+#if PIPELINE_STATS_PERIOD_MS > 0
+    xTaskCreate(pipeline_stats_task, "Pipeline Stats", 3*1024, NULL, 1, NULL);
+#endif
+}
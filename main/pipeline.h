@@ -0,0 +1,43 @@
+/* Sample pipeline
+
+The data path is a graph of statically allocated stages wired together at
+startup (see main.c). Stages exchange batches of struct potentiometer_sample by
+pointer; the batches come from a fixed pool.
+
+A source stage runs its own task, pinned to the core and at the priority it
+declares, and adds its new samples to a batch each time its period comes around.
+The batch is passed on once it is full, or at the last poll before its first
+sample has waited the source's batch_ms. Every other stage
+either runs inline in the task of the stage that feeds it (queue_len 0), or has
+its own task, core and priority and takes batches from an input queue of
+queue_len batches. A stage may filter a batch in place (dropping samples) or
+consume it; the batch then goes on to the stage's outputs in the order they were
+connected. Only the last output may be queued, because the batch changes hands
+there, and the outputs before it must leave the batch as it is.
+
+When a queue is full the batch is dropped and the next batch that gets through
+is flagged with POTENTIOMETER_FLAG_OVERRUN. Each stage counts the batches and
+samples it processed, the samples it dropped and the CPU cycles it spent, and
+the counters are logged every PIPELINE_STATS_PERIOD_MS.
+
+The graph ends with the published snapshot; characteristic values are encoded
+when a subscription is sent one (see gatt_svc.c), not by a stage.
+
+The stages, and how batches move between them, are declared in
+pipeline_graph.h, which also builds on the host. This module runs the graph
+on FreeRTOS: the tasks, queues and batch pool.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "pipeline_graph.h"
+
+#define PIPELINE_POOL_LEN         16     // Batches shared by all stages
+#define PIPELINE_MAX_QUEUE_LEN    16     // Longest input queue
+#define PIPELINE_MAX_STAGES       8
+#define PIPELINE_STATS_PERIOD_MS  10000  // Period of the stage statistics report, 0 to disable
+
+/* Create the queues and tasks of the stages and start the sources */
+void pipeline_start(struct pipeline_stage *const *stages, int count);
+
+#endif // PIPELINE_H
@@ -0,0 +1,151 @@
+/* Implementations for pipeline_graph.h */
+
+/* Header */
+#include "pipeline_graph.h"
+
+/* Standard headers */
+#include <assert.h>
+#include <stddef.h>
+
+/* Private function declarations */
+static bool dispatch(struct pipeline_stage *stage, struct pipeline_batch *batch);
+
+
+/* Private functions */
+static void count_batch(struct pipeline_stage *stage, uint32_t items, uint32_t drops, uint32_t cycles)
+{
+    pipeline_port_lock();
+    stage->stats.batches++;
+    stage->stats.items += items;
+    stage->stats.drops += drops;
+    stage->stats.cycles += cycles;
+    pipeline_port_unlock();
+}
+
+
+static void count_drops(struct pipeline_stage *stage, uint32_t drops)
+{
+    pipeline_port_lock();
+    stage->stats.drops += drops;
+    pipeline_port_unlock();
+}
+
+
+/* Run a stage on a batch and pass what is left on. Returns true if the batch
+ * changed hands into a queue */
+static bool run(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    uint32_t items = batch->count;
+    uint32_t start = pipeline_port_cycles();
+    stage->process(stage, batch);
+    uint32_t cycles = pipeline_port_cycles() - start;
+    count_batch(stage, items, items - batch->count, cycles);
+    return dispatch(stage, batch);
+}
+
+
+/* Hand a batch to a queued stage. Returns true if it was queued */
+static bool enqueue(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    if (stage->overrun) {
+        batch->samples[0].flags |= POTENTIOMETER_FLAG_OVERRUN;
+    }
+    if (pipeline_port_send(stage, batch)) {
+        stage->overrun = false;
+        return true;
+    }
+    /* The stage is not keeping up; flag the next batch that gets through */
+    stage->overrun = true;
+    count_drops(stage, batch->count);
+    return false;
+}
+
+
+static bool dispatch(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    if (batch->count == 0) {
+        return false;
+    }
+    for (int i = 0; i < stage->output_count; i++) {
+        struct pipeline_stage *output = stage->outputs[i];
+        if (output->queue_len > 0) {
+            return enqueue(output, batch);
+        }
+        if (run(output, batch)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Public functions */
+void pipeline_connect(struct pipeline_stage *from, struct pipeline_stage *to)
+{
+    assert(from->output_count < PIPELINE_MAX_OUTPUTS);
+    /* Nothing can follow a queued output: the batch has changed hands */
+    assert(from->output_count == 0 || from->outputs[from->output_count - 1]->queue_len == 0);
+    assert(to->source == NULL);
+    from->outputs[from->output_count++] = to;
+}
+
+
+void pipeline_poll(struct pipeline_stage *source, uint32_t next_poll_ms)
+{
+    struct pipeline_batch *batch = source->open;
+    if (batch == NULL) {
+        batch = pipeline_port_acquire();
+        if (batch == NULL) {
+            /* Every batch is held up downstream; the poll is lost */
+            count_drops(source, 1);
+            return;
+        }
+        batch->count = 0;
+    }
+    uint8_t before = batch->count;
+    uint32_t start = pipeline_port_cycles();
+    bool filled = source->source(source, batch);
+    uint32_t cycles = pipeline_port_cycles() - start;
+    if (filled) {
+        count_batch(source, batch->count - before, 0, cycles);
+    }
+
+    source->open = NULL;
+    if (batch->count == 0) {
+        pipeline_port_release(batch);
+        return;
+    }
+    /* Keep filling while the first sample can wait for the next poll */
+    uint32_t now_ms = pipeline_port_ms();
+    if (before == 0) {
+        source->opened_ms = now_ms;
+    }
+    if (batch->count < PIPELINE_BATCH_LEN && next_poll_ms <= source->batch_ms &&
+        now_ms - source->opened_ms <= source->batch_ms - next_poll_ms) {
+        source->open = batch;
+        return;
+    }
+    if (!dispatch(source, batch)) {
+        pipeline_port_release(batch);
+    }
+}
+
+
+uint32_t pipeline_drain(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    while (batch != NULL) {
+        if (!run(stage, batch)) {
+            pipeline_port_release(batch);
+        }
+        batch = pipeline_port_receive(stage);
+    }
+    return (stage->period_ms != NULL) ? stage->period_ms(stage) : 0;
+}
+
+
+void pipeline_get_stats(const struct pipeline_stage *stage, struct pipeline_stage_stats *stats)
+{
+    pipeline_port_lock();
+    *stats = stage->stats;
+    pipeline_port_unlock();
+}
@@ -0,0 +1,111 @@
+/* Stage graph of the sample pipeline
+
+How a batch moves through the stages wired up for the pipeline (see
+pipeline.h): a source fills a batch taken from the pool over one or more polls,
+until it is full or its first sample would otherwise wait longer than the
+source's batch_ms, then every stage the batch
+reaches filters or consumes it in turn, and a queued stage takes it over, or
+drops it and flags the next batch that gets through when its input queue is
+full. Each time a queued stage wakes it drains its whole input before pausing.
+
+The batch pool, the input queues, the lock around the stage counters, the
+cycle counter and the clock are platform hooks (pipeline_port_*), implemented with FreeRTOS in
+pipeline.c and simulated by the capture replay (bench/host/replay_host.c).
+
+These functions have no ESP-IDF dependencies so they also build on the host.
+*/
+#ifndef PIPELINE_GRAPH_H
+#define PIPELINE_GRAPH_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "snapshot.h"
+
+#define PIPELINE_BATCH_LEN        8      // Samples per batch
+#define PIPELINE_MAX_OUTPUTS      3      // Outputs per stage
+
+/* Samples passed between stages */
+struct pipeline_batch {
+    uint8_t count;
+    struct potentiometer_sample samples[PIPELINE_BATCH_LEN];
+};
+
+/* Per-stage counters */
+struct pipeline_stage_stats {
+    uint32_t batches;  // Batches processed
+    uint32_t items;    // Samples received
+    uint32_t drops;    // Samples filtered out, or lost to a full input queue
+    uint64_t cycles;   // CPU cycles spent in the stage's own function
+};
+
+struct pipeline_stage;
+
+/* Add new samples to batch after the batch->count already in it, without
+ * filling it past PIPELINE_BATCH_LEN. Returns false if there are none */
+typedef bool (*pipeline_source_fn)(struct pipeline_stage *stage, struct pipeline_batch *batch);
+/* Process batch; filters remove samples from it in place */
+typedef void (*pipeline_process_fn)(struct pipeline_stage *stage, struct pipeline_batch *batch);
+/* Time to wait between batches, in ms */
+typedef uint32_t (*pipeline_period_fn)(struct pipeline_stage *stage);
+
+struct pipeline_stage {
+    /* Declaration */
+    const char *name;
+    pipeline_source_fn source;    // Set for sources
+    pipeline_process_fn process;  // Set for every other stage
+    pipeline_period_fn period_ms; // Sources: poll period. Queued stages: pause after draining the queue, or NULL
+    uint16_t batch_ms;            // Sources: longest a sample waits for its batch to fill, 0 to pass every poll on
+    uint8_t queue_len;            // 0: run in the feeding stage's task, otherwise own task and input queue
+    uint8_t core;                 // Sources and queued stages
+    uint8_t priority;
+    uint16_t stack_size;
+    void *ctx;                    // Stage private state
+
+    /* Wiring and runtime state, owned by the pipeline */
+    struct pipeline_stage *outputs[PIPELINE_MAX_OUTPUTS];
+    uint8_t output_count;
+    bool overrun;                 // The last batch for this stage was dropped
+    struct pipeline_batch *open;  // Sources: batch being filled, or NULL
+    uint32_t opened_ms;           // Sources: when the first sample went into it
+    void *input;                  // Input queue, created by the platform
+    struct pipeline_stage_stats stats;
+};
+
+/* Platform hooks */
+/* Take a batch from the pool. Returns NULL if every batch is held by a stage */
+struct pipeline_batch *pipeline_port_acquire(void);
+/* Return a batch to the pool */
+void pipeline_port_release(struct pipeline_batch *batch);
+/* Append batch to the input queue of a queued stage without blocking. Returns
+ * false if the queue is full */
+bool pipeline_port_send(struct pipeline_stage *stage, struct pipeline_batch *batch);
+/* Take the next batch from the input queue of a queued stage without blocking.
+ * Returns NULL if the queue is empty */
+struct pipeline_batch *pipeline_port_receive(struct pipeline_stage *stage);
+/* Free-running CPU cycle counter */
+uint32_t pipeline_port_cycles(void);
+/* Free-running millisecond clock */
+uint32_t pipeline_port_ms(void);
+/* Exclude other tasks while the stage counters are updated or copied */
+void pipeline_port_lock(void);
+void pipeline_port_unlock(void);
+
+/* Feed the batches leaving from into to. Call before the pipeline starts */
+void pipeline_connect(struct pipeline_stage *from, struct pipeline_stage *to);
+
+/* Let a source add its new samples to the batch it is filling, taking one from
+ * the pool if needed. The batch is passed on once it is full, or if the source's
+ * next poll, next_poll_ms from now, would be past its batch_ms. Called by the
+ * source's task once a period */
+void pipeline_poll(struct pipeline_stage *source, uint32_t next_poll_ms);
+
+/* Run a queued stage on batch, just taken from its input queue, and then on every
+ * batch queued behind it. Returns the pause before the stage waits for its
+ * input again, in ms */
+uint32_t pipeline_drain(struct pipeline_stage *stage, struct pipeline_batch *batch);
+
+/* Copy a stage's counters. Safe to call from any task */
+void pipeline_get_stats(const struct pipeline_stage *stage, struct pipeline_stage_stats *stats);
+
+#endif // PIPELINE_GRAPH_H
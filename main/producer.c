@@ -3,23 +3,36 @@
 /* Header */
 #include "producer.h"
 
+/* Standard headers */
+#include <string.h>
+
 /* ESP-IDF headers */
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
 #include "ulp.h"
 #include "ulp_adc.h"
 #include "driver/rtc_io.h"
 #include "ulp_common_defs.h"
+#include "sdkconfig.h"
 
 /* ULP config and ASM-generated header */
 #include "ulp_main.h"  // Generated from adc.S via configs in CMakeLists.txt
 #include "ulp/ulp_config.h"  // Configurations for adc.S as a readable header
 
+/* Application module headers */
+#include "app_config.h"
+#include "clock_sync.h"
+#include "filter.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "trace.h"
+
 #define PRODUCER_LOG_NAME "PRODUCER"
+#define ULP_READ_ATTEMPTS 8  // Reads of a measurement the ULP is writing before the poll gives up
 
 /* Location of ULP binary in the codespace */
 extern const uint8_t ulp_main_bin_start[] asm("_binary_ulp_main_bin_start");
@@ -27,6 +40,60 @@ extern const uint8_t ulp_main_bin_end[]   asm("_binary_ulp_main_bin_end");
 
 /* Value stored by ULP program (read from ADC) on each ULP execution */
 extern uint32_t ulp_last_result;
+/* Measurement counter (see read_ulp_sample) and the wake period register the ULP selected */
+extern uint32_t ulp_sample_count;
+extern uint32_t ulp_wake_period_index;
+/* RTC timer when the ULP took last_result, 16 bits in each word */
+extern uint32_t ulp_sample_ticks_lo;
+extern uint32_t ulp_sample_ticks_hi;
+
+/* Wake periods currently programmed into the ULP timer. Only the producer task
+ * changes them once the ULP is running */
+static uint16_t ulp_periods_ms[ULP_WAKE_PERIOD_COUNT];
+
+
+/* Program the ULP wake up periods.
+ * On the ESP32 these go into SENS_ULP_CP_SLEEP_CYC0_REG..CYC4_REG and the ULP
+ * program picks one for each wake up depending on how much the dial moves.
+ * Other targets have a single period register, so use the slowest period there.
+ */
+static void set_ulp_periods(const uint16_t *periods_ms)
+{
+    memcpy(ulp_periods_ms, periods_ms, sizeof(ulp_periods_ms));
+#if CONFIG_IDF_TARGET_ESP32
+    for (int i = 0; i < ULP_WAKE_PERIOD_COUNT; i++) {
+        ESP_ERROR_CHECK(ulp_set_wakeup_period(i, ulp_periods_ms[i] * 1000));
+    }
+#else
+    ESP_ERROR_CHECK(ulp_set_wakeup_period(0, ulp_periods_ms[ULP_WAKE_PERIOD_COUNT - 1] * 1000));
+#endif
+}
+
+
+/* Period at which the ULP currently takes measurements */
+static uint32_t current_ulp_period_us(void)
+{
+#if CONFIG_IDF_TARGET_ESP32
+    uint32_t index = ulp_wake_period_index & UINT16_MAX;
+    if (index < ULP_WAKE_PERIOD_COUNT) {
+        return ulp_periods_ms[index] * 1000;
+    }
+#endif
+    return ulp_periods_ms[ULP_WAKE_PERIOD_COUNT - 1] * 1000;
+}
+
+
+/* RTC timer when the ULP took its latest measurement (see clock_sync.h) */
+static uint32_t ulp_sample_ticks(void)
+{
+#if CONFIG_IDF_TARGET_ESP32
+    return (ulp_sample_ticks_hi & UINT16_MAX) << 16 | (ulp_sample_ticks_lo & UINT16_MAX);
+#else
+    /* The ULP program only reads the RTC timer on the ESP32. The producer polls
+     * once a period, so the measurement is on average half a period old */
+    return clock_sync_ticks() - clock_sync_us_to_ticks(current_ulp_period_us() / 2);
+#endif
+}
 
 
 /* This function is called once after power-on reset, to load ULP program into
@@ -48,12 +115,10 @@ static void init_ulp_program(void)
 
     ESP_ERROR_CHECK(ulp_adc_init(&cfg));
 
-    /* Set ULP wake up period to 200ms (5Hz).
-     * This sets the SENS_ULP_CP_SLEEP_CYC0_REG.
-     * There are 5 of these registers available (CYC0..CYC4) but 0 is used 
-     * by default on ESP32 boards. 
-     */
-    ulp_set_wakeup_period(0, ULP_WAKEUP_PERIOD_US);
+    /* Set the ULP wake up periods from the configuration */
+    struct app_config config;
+    app_config_get(&config);
+    set_ulp_periods(config.ulp_period_ms);
 
     /* Disconnect GPIO12 and GPIO15 to remove current drain through
      * pullup/pulldown resistors on modules which have these (e.g. ESP32-WROVER)
@@ -75,48 +140,138 @@ static void start_ulp_program(void)
 }
 
 
-/* Task that checks for new values from the ULP and publishes them to a queue */
-static void ulp_value_publisher_task(void *pvParameters)
+/* State of the ULP source between polls */
+struct ulp_source {
+    uint32_t previous_count;      // ULP sample_count of the last measurement taken
+    uint32_t previous_period_us;  // ULP wake period at the last poll
+};
+
+/* State of the change filter */
+struct change_filter {
+    uint32_t previous;  // Last value let through
+};
+
+static struct ulp_source ulp_source;
+static struct change_filter change_filter;
+
+
+/* Poll at the rate the ULP is currently sampling, so a sample is at most one period old */
+static uint32_t ulp_source_period_ms(struct pipeline_stage *stage)
 {
-    QueueHandle_t value_queue = (QueueHandle_t)pvParameters;
-    TickType_t poll_period_ticks = pdMS_TO_TICKS(ADC_CHANGE_POLL_PERIOD);
-    uint32_t ulp_previous_result = ulp_last_result;
-    uint32_t adc_diff;
-    while (true)
-    {
-        // Delay so we're not constantly spinning
-        vTaskDelay(poll_period_ticks);
-        // Calculate if the ADC changed more than the specified tolerance
-        adc_diff = (ulp_previous_result > ulp_last_result) ? (ulp_previous_result - ulp_last_result) : (ulp_last_result - ulp_previous_result);
-        if (adc_diff > ADC_CHANGE_TOL) {
-            ESP_LOGI(PRODUCER_LOG_NAME, "ADC value changed! Latest value reported by ULP program is %"PRIu32"\n", 
-                ulp_last_result & UINT16_MAX);
-            // Send new value to the queue for later consumption
-            BaseType_t result = xQueueSendToBack(value_queue, &ulp_last_result, 0);
-            if (result != pdPASS) {
-                ESP_LOGE(PRODUCER_LOG_NAME, "Failed to push value to queue. This may mean that the consumer is not consuming data fast enough.\n");
-            }
-            ulp_previous_result = ulp_last_result;
+    struct ulp_source *source = stage->ctx;
+    struct app_config config;
+
+    // Pick up configuration changes
+    app_config_get(&config);
+    if (memcmp(config.ulp_period_ms, ulp_periods_ms, sizeof(ulp_periods_ms)) != 0) {
+        set_ulp_periods(config.ulp_period_ms);
+    }
+    uint32_t ulp_period_us = current_ulp_period_us();
+    if (ulp_period_us != source->previous_period_us) {
+        trace_event(TRACE_EV_ULP_PERIOD, ulp_wake_period_index & UINT16_MAX, ulp_period_us);
+        source->previous_period_us = ulp_period_us;
+    }
+    return ulp_period_us / 1000;
+}
+
+
+/* ULP sample_count, which is odd while the ULP writes a measurement */
+static uint32_t ulp_read_count(void)
+{
+    return __atomic_load_n(&ulp_sample_count, __ATOMIC_ACQUIRE) & UINT16_MAX;
+}
+
+
+/* Copy the ULP's latest measurement and its stamp. Returns false, and the sample
+ * is left for the next poll, if the ULP kept writing over it */
+static bool read_ulp_sample(uint32_t *count, uint16_t *value, uint32_t *rtc_ticks)
+{
+    for (int attempt = 0; attempt < ULP_READ_ATTEMPTS; attempt++) {
+        uint32_t before = ulp_read_count();
+        if (before & 1) {
+            continue;
+        }
+        *value = (uint16_t)(ulp_last_result & UINT16_MAX);
+        *rtc_ticks = ulp_sample_ticks();
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (ulp_read_count() == before) {
+            *count = before;
+            return true;
         }
     }
+    return false;
 }
 
 
-void potentiometer_data_producer_init(void *pQueue)
+/* Take the ULP's latest measurement, if it took one since the last poll */
+static bool ulp_source_poll(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    struct ulp_source *source = stage->ctx;
+    uint32_t count;
+    uint16_t value;
+    uint32_t rtc_ticks;
+
+    // Nothing to do until the ULP has taken a new measurement
+    if (ulp_read_count() == source->previous_count ||
+        !read_ulp_sample(&count, &value, &rtc_ticks) || count == source->previous_count) {
+        return false;
+    }
+    source->previous_count = count;
+    /* Date the sample by when the ULP took it, not by this poll */
+    uint32_t age_ticks = clock_sync_ticks() - rtc_ticks;
+    batch->samples[batch->count++] = (struct potentiometer_sample){
+        .timestamp_us = esp_timer_get_time() - clock_sync_ticks_to_us(age_ticks),
+        .rtc_ticks = rtc_ticks,
+        .value = value,
+        .flags = 0,
+    };
+    return true;
+}
+
+
+/* Keep only samples that changed more than the configured tolerance */
+static void change_filter_process(struct pipeline_stage *stage, struct pipeline_batch *batch)
+{
+    struct change_filter *filter = stage->ctx;
+    struct app_config config;
+    uint32_t previous = filter->previous;
+
+    app_config_get(&config);
+    batch->count = adc_change_filter(batch->samples, batch->count, &filter->previous,
+                                     config.adc_change_tol);
+    for (int i = 0; i < batch->count; i++) {
+        trace_event(TRACE_EV_ADC_CHANGED, batch->samples[i].value, previous);
+        previous = batch->samples[i].value;
+    }
+}
+
+
+struct pipeline_stage ulp_source_stage = {
+    .name = "ulp",
+    .source = ulp_source_poll,
+    .period_ms = ulp_source_period_ms,
+    .batch_ms = PRODUCER_BATCH_MS,
+    .core = PRODUCER_CORE,
+    .priority = PRODUCER_PRIORITY,
+    .stack_size = 3072,
+    .ctx = &ulp_source,
+};
+
+struct pipeline_stage change_filter_stage = {
+    .name = "change",
+    .process = change_filter_process,
+    .ctx = &change_filter,
+};
+
+
+void potentiometer_data_producer_init(void)
 {
     /* Initialize the ULP and start sampling the ADC */
     init_ulp_program();
     start_ulp_program();
     ESP_LOGI(PRODUCER_LOG_NAME, "ULP ADC-sampling program started\n");
 
-    /* Start the task that pushes ADC values sampled by the ULP to a data queue */
-    xTaskCreatePinnedToCore(
-        ulp_value_publisher_task,
-        "Producer Task",
-        2048,
-        pQueue,  // Pass queue as parameter to task
-        PRODUCER_PRIORITY,
-        NULL,
-        PRODUCER_CORE
-    );
+    /* Changes are measured from the ULP's first result */
+    ulp_source.previous_count = ulp_read_count() & ~1u;
+    change_filter.previous = ulp_last_result & UINT16_MAX;
 }
@@ -1,19 +1,31 @@
 /* This contains code related to retrieving potentiometer values written by the ULP process from the ADC 
-and publishing them to a queue for later consumption.
+and filtering them by change tolerance, as the first stages of the pipeline (see pipeline.h).
 
 The program that runs on the ULP FSM is defined in ulp/adc.S and configured by ulp/ulp_config.h 
 */
 #ifndef PRODUCER_H
 #define PRODUCER_H
 
-/* Define parameters related to polling the value read from the ADC */
+struct pipeline_stage;
+
+/* Defaults for parameters related to polling the value read from the ADC.
+ * These can be changed at runtime, see app_config.h */
 #define ADC_CHANGE_TOL          10  // ADC value change that triggers update
-#define ADC_CHANGE_POLL_PERIOD  200  // in ms (5Hz)
-#define ULP_WAKEUP_PERIOD_US  500000  // 50 milliseconds (20Hz)
+/* ULP wake periods, fastest first, indexed by the SENS_ULP_CP_SLEEP_CYCx register
+ * the ULP selects (see ulp/ulp_config.h). The producer polls at the current one.
+ * Targets other than the ESP32 only have one register and always use the slowest.
+ */
+#define ULP_WAKEUP_PERIODS_MS  {20, 50, 100, 200, 500}  // 50Hz down to 2Hz
 #define PRODUCER_CORE  1
 #define PRODUCER_PRIORITY 5
+#define PRODUCER_BATCH_MS 100  // Longest a sample waits in the source for its batch to fill
+
+/* Source stage: the ULP's measurements, polled at its current wake period, on PRODUCER_CORE */
+extern struct pipeline_stage ulp_source_stage;
+/* Filter stage: drops samples that changed by ADC_CHANGE_TOL or less (runtime configurable) */
+extern struct pipeline_stage change_filter_stage;
 
-/* Function that initializes and starts the process of pushing ADC values to a data queue */
-void potentiometer_data_producer_init(void *pQueue);
+/* Function that loads and starts the ULP program. Call before starting the pipeline */
+void potentiometer_data_producer_init(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,217 @@
+/* Implementations for sched_trace.h */
+
+/* Header */
+#include "sched_trace.h"
+
+/* Standard headers */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ESP-IDF headers */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/* Application module headers */
+#include "trace.h"
+
+#define SCHED_TRACE_LOG_NAME "SCHED_TRACE"
+
+#if SCHED_TRACE_ENABLED
+
+/* Records captured on one core. Only that core writes it (with interrupts masked)
+ * and it is only read once the capture has stopped.
+ */
+struct sched_trace_ring {
+    struct sched_trace_record records[SCHED_TRACE_RING_SIZE];
+    uint32_t count;
+};
+
+/* Queue registered with sched_trace_watch_queue */
+struct sched_watched_queue {
+    void *queue;
+    const char *name;
+};
+
+/* The hooks run inside the scheduler, possibly while the flash cache is disabled,
+ * so everything they touch lives in internal RAM */
+static DRAM_ATTR struct sched_trace_ring sched_rings[portNUM_PROCESSORS];
+static DRAM_ATTR struct sched_watched_queue sched_queues[SCHED_TRACE_MAX_QUEUES];
+static DRAM_ATTR volatile bool sched_capturing = false;
+
+static const char *const sched_type_names[] = {
+    [SCHED_EV_SWITCH_IN] = "switch_in",
+    [SCHED_EV_READY] = "ready",
+    [SCHED_EV_QUEUE_SEND] = "queue_send",
+    [SCHED_EV_QUEUE_RECEIVE] = "queue_receive",
+    [SCHED_EV_PIPELINE] = "pipeline",
+};
+
+
+static IRAM_ATTR void sched_record(uint8_t type, uint16_t id, uint32_t arg)
+{
+    if (!sched_capturing) {
+        return;
+    }
+
+    UBaseType_t irq_state = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint8_t core = (uint8_t)xPortGetCoreID();
+    struct sched_trace_ring *ring = &sched_rings[core];
+    if (ring->count < SCHED_TRACE_RING_SIZE) {
+        struct sched_trace_record *record = &ring->records[ring->count++];
+        record->timestamp_us = (uint32_t)esp_timer_get_time();
+        record->type = type;
+        record->core = core;
+        record->id = id;
+        record->arg = arg;
+    } else {
+        /* Stop both cores together so their capture windows line up */
+        sched_capturing = false;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq_state);
+}
+
+
+IRAM_ATTR void sched_trace_task_switched_in(void)
+{
+    sched_record(SCHED_EV_SWITCH_IN, 0, (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle());
+}
+
+
+IRAM_ATTR void sched_trace_task_ready(void *task)
+{
+    sched_record(SCHED_EV_READY, 0, (uint32_t)(uintptr_t)task);
+}
+
+
+IRAM_ATTR void sched_trace_queue(int operation, void *queue)
+{
+    for (int i = 0; i < SCHED_TRACE_MAX_QUEUES; i++) {
+        if (sched_queues[i].queue == queue && queue != NULL) {
+            sched_record(operation == SCHED_TRACE_QUEUE_SEND ? SCHED_EV_QUEUE_SEND : SCHED_EV_QUEUE_RECEIVE,
+                (uint16_t)i, (uint32_t)(uintptr_t)queue);
+            return;
+        }
+    }
+}
+
+
+void sched_trace_pipeline(uint16_t event, uint32_t arg)
+{
+    sched_record(SCHED_EV_PIPELINE, event, arg);
+}
+
+
+void sched_trace_watch_queue(void *queue, const char *name)
+{
+    for (int i = 0; i < SCHED_TRACE_MAX_QUEUES; i++) {
+        if (sched_queues[i].queue == NULL) {
+            sched_queues[i].name = name;
+            sched_queues[i].queue = queue;
+            return;
+        }
+    }
+    ESP_LOGE(SCHED_TRACE_LOG_NAME, "no room to watch queue %s", name);
+}
+
+
+/* Print the name and priority of every task so handles can be resolved offline */
+static void dump_tasks(void)
+{
+    UBaseType_t count = uxTaskGetNumberOfTasks();
+    TaskStatus_t *tasks = malloc(count * sizeof(TaskStatus_t));
+    if (tasks == NULL) {
+        ESP_LOGE(SCHED_TRACE_LOG_NAME, "no memory to list tasks");
+        return;
+    }
+    count = uxTaskGetSystemState(tasks, count, NULL);
+    for (UBaseType_t i = 0; i < count; i++) {
+        printf("TASK,0x%08"PRIx32",%s,%u\n", (uint32_t)(uintptr_t)tasks[i].xHandle, tasks[i].pcTaskName,
+            (unsigned)tasks[i].uxCurrentPriority);
+    }
+    free(tasks);
+}
+
+
+void sched_trace_dump(void)
+{
+    printf("SCHED_TRACE_BEGIN\n");
+    dump_tasks();
+    for (int i = 0; i < SCHED_TRACE_MAX_QUEUES; i++) {
+        if (sched_queues[i].queue != NULL) {
+            printf("QUEUE,%d,%s\n", i, sched_queues[i].name);
+        }
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const struct sched_trace_ring *ring = &sched_rings[core];
+        for (uint32_t i = 0; i < ring->count; i++) {
+            const struct sched_trace_record *record = &ring->records[i];
+            const char *id_name = (record->type == SCHED_EV_PIPELINE) ? trace_event_name(record->id) : "";
+            printf("EV,%"PRIu32",%u,%s,%u,%s,0x%08"PRIx32"\n", record->timestamp_us, record->core,
+                sched_type_names[record->type], record->id, id_name, record->arg);
+        }
+    }
+    printf("SCHED_TRACE_END\n");
+}
+
+
+/* Capture once, shortly after boot, then print the result */
+static void sched_trace_task(void *pvParameters)
+{
+    vTaskDelay(pdMS_TO_TICKS(SCHED_TRACE_START_DELAY_MS));
+
+    ESP_LOGW(SCHED_TRACE_LOG_NAME, "capturing for up to %d ms", SCHED_TRACE_CAPTURE_MS);
+    sched_capturing = true;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(SCHED_TRACE_CAPTURE_MS);
+    while (sched_capturing && (int32_t)(deadline - xTaskGetTickCount()) > 0) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    sched_capturing = false;
+    /* Let a record in progress on the other core complete */
+    vTaskDelay(1);
+
+    sched_trace_dump();
+    vTaskDelete(NULL);
+}
+
+
+void sched_trace_init(void)
+{
+    xTaskCreatePinnedToCore(
+        sched_trace_task,
+        "Sched Trace",
+        3072,
+        NULL,
+        1,
+        NULL,
+        0
+    );
+}
+
+#else  // SCHED_TRACE_ENABLED
+
+void sched_trace_watch_queue(void *queue, const char *name)
+{
+    (void)queue;
+    (void)name;
+}
+
+void sched_trace_pipeline(uint16_t event, uint32_t arg)
+{
+    (void)event;
+    (void)arg;
+}
+
+void sched_trace_dump(void)
+{
+    ESP_LOGW(SCHED_TRACE_LOG_NAME, "scheduler trace is disabled, see SCHED_TRACE_ENABLED");
+}
+
+void sched_trace_init(void)
+{
+}
+
+#endif  // SCHED_TRACE_ENABLED
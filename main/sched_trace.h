@@ -0,0 +1,55 @@
+/* Scheduler trace capture
+
+When SCHED_TRACE_ENABLED is set in sched_trace_hooks.h, FreeRTOS is compiled with
+hooks that record context switches, tasks becoming ready and sends/receives on
+watched queues into per-core RAM buffers, together with the application's own
+pipeline events (see trace.h). A capture runs once after boot and is printed to
+the serial console as text. bench/sched_trace.py converts the
+captured log into Chrome trace / Perfetto JSON and prints per-task run and
+response times.
+
+Interrupt entries are not captured: ESP-IDF only exposes ISR hooks to SystemView.
+*/
+#ifndef SCHED_TRACE_H
+#define SCHED_TRACE_H
+
+#include <inttypes.h>
+
+#include "sched_trace_hooks.h"
+
+#define SCHED_TRACE_RING_SIZE       1024  // Records per core
+#define SCHED_TRACE_START_DELAY_MS  5000  // Let the pipeline and BLE settle before capturing
+#define SCHED_TRACE_CAPTURE_MS      2000  // Longest capture; it also stops when a buffer fills
+#define SCHED_TRACE_MAX_QUEUES      4     // Queues that can be watched
+
+/* Record types */
+enum sched_trace_type {
+    SCHED_EV_SWITCH_IN,      // arg: task handle
+    SCHED_EV_READY,          // arg: task handle
+    SCHED_EV_QUEUE_SEND,     // arg: queue handle
+    SCHED_EV_QUEUE_RECEIVE,  // arg: queue handle
+    SCHED_EV_PIPELINE,       // id: enum trace_event, arg: first event argument
+};
+
+struct sched_trace_record {
+    uint32_t timestamp_us;  // Low 32 bits of esp_timer_get_time()
+    uint8_t type;           // enum sched_trace_type
+    uint8_t core;
+    uint16_t id;
+    uint32_t arg;
+};
+
+/* Record sends and receives on a queue. Other queues (including semaphores and
+ * mutexes, which are queues too) are ignored */
+void sched_trace_watch_queue(void *queue, const char *name);
+
+/* Record an application pipeline event (called from trace_event) */
+void sched_trace_pipeline(uint16_t event, uint32_t arg);
+
+/* Print the captured records to the console */
+void sched_trace_dump(void);
+
+/* Start the task that runs the capture. Does nothing unless SCHED_TRACE_ENABLED */
+void sched_trace_init(void);
+
+#endif // SCHED_TRACE_H
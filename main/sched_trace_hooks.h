@@ -0,0 +1,30 @@
+/* FreeRTOS trace hook definitions for the scheduler trace (see sched_trace.h)
+
+While SCHED_TRACE_ENABLED is set, the top level CMakeLists.txt force-includes
+this header into the FreeRTOS component, so that FreeRTOS itself is compiled with
+the hooks. It must only contain macros and declarations, and the define below
+must stay on a line of its own, where CMake looks for it.
+*/
+#ifndef SCHED_TRACE_HOOKS_H
+#define SCHED_TRACE_HOOKS_H
+
+#define SCHED_TRACE_ENABLED 0  // Set to 1 to compile the scheduler trace hooks into FreeRTOS
+
+/* Queue operations passed to sched_trace_queue */
+#define SCHED_TRACE_QUEUE_SEND    0
+#define SCHED_TRACE_QUEUE_RECEIVE 1
+
+#if SCHED_TRACE_ENABLED
+void sched_trace_task_switched_in(void);
+void sched_trace_task_ready(void *task);
+void sched_trace_queue(int operation, void *queue);
+
+#define traceTASK_SWITCHED_IN()                  sched_trace_task_switched_in()
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB)    sched_trace_task_ready((void *)(pxTCB))
+#define traceQUEUE_SEND(pxQueue)                 sched_trace_queue(SCHED_TRACE_QUEUE_SEND, (void *)(pxQueue))
+#define traceQUEUE_SEND_FROM_ISR(pxQueue)        sched_trace_queue(SCHED_TRACE_QUEUE_SEND, (void *)(pxQueue))
+#define traceQUEUE_RECEIVE(pxQueue)              sched_trace_queue(SCHED_TRACE_QUEUE_RECEIVE, (void *)(pxQueue))
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue)     sched_trace_queue(SCHED_TRACE_QUEUE_RECEIVE, (void *)(pxQueue))
+#endif
+
+#endif // SCHED_TRACE_HOOKS_H
@@ -0,0 +1,52 @@
+/* Sequence-counted latch for sharing a small value between tasks without locks
+
+The writer keeps two copies of the value and bumps the sequence number before
+updating each one, so there is always one copy that is not being modified.
+Readers pick that copy from the sequence number and retry only if the writer
+completed a step while they were copying. A reader that preempts the writer
+(on either core) therefore never waits for it, and the writer never blocks.
+
+Only one task may write a given latch.
+*/
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+struct seqlock {
+    uint32_t seq;
+};
+
+/* Publish a new value. copies points to an array of two value-sized elements */
+static inline void seqlock_write(struct seqlock *lock, void *copies, const void *value, size_t size)
+{
+    uint8_t *copy = (uint8_t *)copies;
+    uint32_t seq = lock->seq;
+
+    /* Odd: readers use copy 1 while copy 0 is updated */
+    __atomic_store_n(&lock->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(copy, value, size);
+
+    /* Even: readers use copy 0 while copy 1 is updated */
+    __atomic_store_n(&lock->seq, seq + 2, __ATOMIC_RELEASE);
+    memcpy(copy + size, value, size);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Copy out a consistent value. copies points to the same array passed to seqlock_write */
+static inline void seqlock_read(const struct seqlock *lock, const void *copies, void *value, size_t size)
+{
+    const uint8_t *copy = (const uint8_t *)copies;
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE);
+        memcpy(value, copy + (seq & 1) * size, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&lock->seq, __ATOMIC_RELAXED) != seq);
+}
+
+#endif // SEQLOCK_H
@@ -0,0 +1,37 @@
+/* Implementations for snapshot.h */
+
+/* Header */
+#include "snapshot.h"
+
+#include "seqlock.h"
+
+static struct seqlock snapshot_lock;
+static struct potentiometer_snapshot snapshot_copies[2];
+static uint32_t snapshot_published;  // Only touched by the writer
+
+
+void snapshot_publish(const struct potentiometer_sample *sample)
+{
+    struct potentiometer_snapshot snapshot = {
+        .timestamp_us = sample->timestamp_us,
+        .rtc_ticks = sample->rtc_ticks,
+        .seq = ++snapshot_published,
+        .value = sample->value,
+        .flags = sample->flags | POTENTIOMETER_FLAG_VALID,
+    };
+    seqlock_write(&snapshot_lock, snapshot_copies, &snapshot, sizeof(snapshot));
+}
+
+
+void snapshot_read(struct potentiometer_snapshot *snapshot)
+{
+    seqlock_read(&snapshot_lock, snapshot_copies, snapshot, sizeof(*snapshot));
+}
+
+
+size_t snapshot_encode(const struct potentiometer_snapshot *snapshot, uint8_t *payload)
+{
+    payload[0] = (uint8_t)(snapshot->value & 0xFF);
+    payload[1] = (uint8_t)(snapshot->value >> 8);
+    return POTENTIOMETER_PAYLOAD_LEN;
+}
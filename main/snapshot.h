@@ -0,0 +1,46 @@
+/* Published potentiometer state shared by the GATT read and notify paths
+
+The consumer publishes every new sample as a snapshot (value, sequence number,
+capture timestamp and quality flags). Readers on either core get a consistent
+copy without taking a lock, see seqlock.h.
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define POTENTIOMETER_PAYLOAD_LEN 2  // Little-endian uint16_t ADC code
+
+/* Quality flags */
+#define POTENTIOMETER_FLAG_VALID    0x0001  // A sample has been published since boot
+#define POTENTIOMETER_FLAG_OVERRUN  0x0002  // Samples were lost in a pipeline queue before this one
+
+/* Sample passed between pipeline stages, in batches (see pipeline.h) */
+struct potentiometer_sample {
+    int64_t timestamp_us;  // esp_timer time at which the ULP took the value
+    uint32_t rtc_ticks;    // RTC timer when the ULP took the value, low 32 bits (see clock_sync.h)
+    uint16_t value;        // Averaged ADC code
+    uint16_t flags;        // POTENTIOMETER_FLAG_*
+};
+
+/* Latest published state */
+struct potentiometer_snapshot {
+    int64_t timestamp_us;  // Capture time of value
+    uint32_t rtc_ticks;    // RTC timer when the ULP took value
+    uint32_t seq;          // Number of samples published so far
+    uint16_t value;
+    uint16_t flags;
+};
+
+/* Publish a new sample. Only the consumer task may call this */
+void snapshot_publish(const struct potentiometer_sample *sample);
+
+/* Copy the latest published state. Safe to call from any task */
+void snapshot_read(struct potentiometer_snapshot *snapshot);
+
+/* Encode the characteristic value of a snapshot into payload, which must hold
+ * POTENTIOMETER_PAYLOAD_LEN bytes. Returns the number of bytes written */
+size_t snapshot_encode(const struct potentiometer_snapshot *snapshot, uint8_t *payload);
+
+#endif // SNAPSHOT_H
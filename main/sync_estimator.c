@@ -0,0 +1,247 @@
+/* Implementations for sync_estimator.h */
+
+/* Header */
+#include "sync_estimator.h"
+
+/* Standard headers */
+#include <math.h>
+#include <string.h>
+
+
+static uint32_t clamp_u32(double value)
+{
+    if (value >= (double)UINT32_MAX) {
+        return UINT32_MAX - 1;
+    }
+    return value > 0 ? (uint32_t)value : 0;
+}
+
+
+static int32_t clamp_i32(int64_t value)
+{
+    if (value > INT32_MAX) {
+        return INT32_MAX;
+    }
+    return value < INT32_MIN ? INT32_MIN : (int32_t)value;
+}
+
+
+/* The points of the window, oldest first */
+static const struct sync_point *window_point(const struct sync_estimator *estimator, int i)
+{
+    int oldest = estimator->count < SYNC_WINDOW_LEN ? 0 : estimator->next;
+    return &estimator->window[(oldest + i) % SYNC_WINDOW_LEN];
+}
+
+
+/* Compare an exchange with what the model predicted before it was added */
+static void record_error(struct sync_estimator *estimator, const struct sync_point *point)
+{
+    struct sync_stats *stats = &estimator->stats;
+    int64_t predicted_us;
+    uint32_t bound_us;
+
+    if (!sync_model_map(&estimator->model, (uint32_t)point->ticks, &predicted_us, &bound_us)) {
+        return;
+    }
+    int64_t error_us = point->us - predicted_us;
+    uint32_t magnitude = clamp_u32(fabs((double)error_us));
+
+    estimator->predictions++;
+    estimator->error_sum_sq += (double)error_us * (double)error_us;
+    stats->last_error_us = clamp_i32(error_us);
+    if (magnitude > stats->max_error_us) {
+        stats->max_error_us = magnitude;
+    }
+    stats->rms_error_us = clamp_u32(sqrt(estimator->error_sum_sq / estimator->predictions));
+}
+
+
+/* True if point is consistent with the model, given both their errors */
+static bool agrees(const struct sync_model *model, const struct sync_point *point)
+{
+    int64_t predicted_us;
+    uint32_t bound_us;
+
+    sync_model_map(model, (uint32_t)point->ticks, &predicted_us, &bound_us);
+    return fabs((double)(point->us - predicted_us)) <= (double)bound_us + point->delay_us / 2.0;
+}
+
+
+/* Fit central time against local ticks over the low-delay points of the window */
+static void fit(struct sync_estimator *estimator)
+{
+    struct sync_model *model = &estimator->model;
+    uint32_t min_delay_us = UINT32_MAX;
+
+    for (int i = 0; i < estimator->count; i++) {
+        const struct sync_point *point = window_point(estimator, i);
+        if (point->delay_us < min_delay_us) {
+            min_delay_us = point->delay_us;
+        }
+    }
+    uint32_t max_delay_us = 2 * min_delay_us + SYNC_DELAY_SLACK_US;
+
+    /* Oldest and newest points that qualify */
+    const struct sync_point *first = NULL;
+    const struct sync_point *last = NULL;
+    int n = 0;
+    for (int i = 0; i < estimator->count; i++) {
+        const struct sync_point *point = window_point(estimator, i);
+        if (point->delay_us > max_delay_us) {
+            continue;
+        }
+        if (first == NULL) {
+            first = point;
+        }
+        last = point;
+        n++;
+    }
+    /* Least squares, relative to the newest point so the sums stay small */
+    double mean_x = 0;
+    double mean_y = 0;
+    for (int i = 0; i < estimator->count; i++) {
+        const struct sync_point *point = window_point(estimator, i);
+        if (point->delay_us <= max_delay_us) {
+            mean_x += (double)(point->ticks - last->ticks) / n;
+            mean_y += (double)(point->us - last->us) / n;
+        }
+    }
+    double sxx = 0;
+    double sxy = 0;
+    for (int i = 0; i < estimator->count; i++) {
+        const struct sync_point *point = window_point(estimator, i);
+        if (point->delay_us <= max_delay_us) {
+            double dx = (double)(point->ticks - last->ticks) - mean_x;
+            double dy = (double)(point->us - last->us) - mean_y;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+    }
+
+    double nominal = estimator->nominal_us_per_tick;
+    double span_us = (double)(last->ticks - first->ticks) * nominal;
+    double slope = nominal;
+    double offset_us = 0;         // Fitted minus measured time at the newest point
+    double nominal_error = SYNC_NOMINAL_PPM * 1e-6;
+    double slope_error = nominal_error;
+    if (n >= 2 && sxx > 0) {
+        double fitted = sxy / sxx;
+        double fitted_offset_us = mean_y - fitted * mean_x;
+        /* Both end points are within their error of the true line, so its slope is
+         * within the combined error over the span of the fitted one */
+        double first_residual = (double)(first->us - last->us) - fitted_offset_us
+                                - fitted * (double)(first->ticks - last->ticks);
+        double fitted_error = (first->delay_us / 2.0 + fabs(first_residual) +
+                               last->delay_us / 2.0 + fabs(fitted_offset_us)) / span_us;
+        if (fitted_error < nominal_error && fabs(fitted / nominal - 1) < nominal_error) {
+            slope = fitted;
+            offset_us = fitted_offset_us;
+            slope_error = fitted_error;
+        }
+    }
+
+    model->ref_ticks = (uint32_t)last->ticks;
+    model->ref_us = last->us + llround(offset_us);
+    model->us_per_tick = slope;
+    model->ref_error_us = clamp_u32(ceil(last->delay_us / 2.0 + fabs(offset_us)));
+    model->slope_error = slope_error + SYNC_WANDER_PPM * 1e-6;
+    model->valid = true;
+
+    estimator->stats.min_delay_us = min_delay_us;
+    estimator->stats.fitted = n;
+    estimator->stats.error_bound_us = model->ref_error_us;
+    estimator->stats.drift_ppb = clamp_i32(llround((nominal / slope - 1) * 1e9));
+}
+
+
+/* Drop every exchange and the model, keeping the configuration */
+static void start_over(struct sync_estimator *estimator)
+{
+    double nominal_us_per_tick = estimator->nominal_us_per_tick;
+    uint32_t max_round_trip_us = estimator->max_round_trip_us;
+
+    memset(estimator, 0, sizeof(*estimator));
+    estimator->nominal_us_per_tick = nominal_us_per_tick;
+    estimator->max_round_trip_us = max_round_trip_us;
+}
+
+
+/* Public functions */
+void sync_estimator_reset(struct sync_estimator *estimator, double nominal_us_per_tick)
+{
+    estimator->nominal_us_per_tick = nominal_us_per_tick;
+    start_over(estimator);
+    sync_estimator_set_interval(estimator, SYNC_MAX_EVENT_INTERVAL_US);
+}
+
+
+void sync_estimator_set_interval(struct sync_estimator *estimator, uint32_t event_interval_us)
+{
+    uint64_t limit = (uint64_t)SYNC_ROUND_TRIP_EVENTS * event_interval_us + SYNC_ROUND_TRIP_SLACK_US;
+    estimator->max_round_trip_us = limit < UINT32_MAX ? (uint32_t)limit : UINT32_MAX;
+}
+
+
+bool sync_estimator_add(struct sync_estimator *estimator, const struct sync_exchange *exchange)
+{
+    struct sync_stats *stats = &estimator->stats;
+    double us_per_tick = estimator->model.valid ? estimator->model.us_per_tick
+                                                : estimator->nominal_us_per_tick;
+    int64_t round_trip_us = exchange->return_us - exchange->send_us;
+    uint32_t processing_ticks = exchange->reply_ticks - exchange->receive_ticks;
+    double processing_us = processing_ticks * us_per_tick;
+
+    if (round_trip_us <= 0 || round_trip_us > estimator->max_round_trip_us ||
+        processing_us > (double)round_trip_us) {
+        stats->rejected++;
+        return false;
+    }
+
+    uint32_t midpoint = exchange->receive_ticks + processing_ticks / 2;
+    struct sync_point point = {
+        .ticks = midpoint,
+        .us = exchange->send_us + round_trip_us / 2,
+        .delay_us = clamp_u32(round_trip_us - processing_us),
+    };
+    if (estimator->model.valid && !agrees(&estimator->model, &point)) {
+        /* The central's clock jumped, or it's another central */
+        start_over(estimator);
+    }
+    if (estimator->count > 0) {
+        /* Extend the tick count from the newest point, so the window never wraps */
+        const struct sync_point *newest = window_point(estimator, estimator->count - 1);
+        point.ticks = newest->ticks + (int32_t)(midpoint - (uint32_t)newest->ticks);
+        if (point.ticks <= newest->ticks || point.us <= newest->us) {
+            stats->rejected++;
+            return false;
+        }
+    }
+
+    record_error(estimator, &point);
+    estimator->window[estimator->next] = point;
+    estimator->next = (estimator->next + 1) % SYNC_WINDOW_LEN;
+    if (estimator->count < SYNC_WINDOW_LEN) {
+        estimator->count++;
+    }
+    stats->exchanges++;
+    stats->last_delay_us = point.delay_us;
+    fit(estimator);
+    return true;
+}
+
+
+bool sync_model_map(const struct sync_model *model, uint32_t ticks, int64_t *time_us,
+                    uint32_t *error_us)
+{
+    if (!model->valid) {
+        *time_us = 0;
+        *error_us = SYNC_ERROR_UNKNOWN;
+        return false;
+    }
+    /* Wraps correctly as long as ticks is within 2^31 of the reference */
+    double delta_us = (int32_t)(ticks - model->ref_ticks) * model->us_per_tick;
+    *time_us = model->ref_us + llround(delta_us);
+    *error_us = clamp_u32(ceil(model->ref_error_us + fabs(delta_us) * model->slope_error) + 1);
+    return true;
+}
@@ -0,0 +1,113 @@
+/* Clock offset and drift estimation for the time sync service
+
+The central times each exchange on its own clock (send_us, return_us) and the
+device on the RTC slow clock timer (receive_ticks, reply_ticks), the timer the
+ULP stamps samples with. An exchange tells us that at local tick
+(receive_ticks + reply_ticks) / 2 the central's clock read
+(send_us + return_us) / 2, give or take half the round trip spent on the air.
+
+The estimator keeps the last SYNC_WINDOW_LEN exchanges, drops those whose
+round trip was well above the window's best (BLE delays are lumpy: a request
+or reply that missed a connection event waits for the next one), and fits
+central time against local ticks by least squares. The slope absorbs both the
+error of the RTC clock calibration and its drift.
+
+The model maps a 32-bit tick count to central time along with a bound on the
+error, made of:
+- the half round trip and fit residual of the newest exchange in the fit,
+- the uncertainty of the slope over the span of the fit,
+- SYNC_WANDER_PPM of frequency change over the time since that exchange.
+Tick counts must be within 2^31 ticks of the newest exchange (hours at the
+RTC's ~150kHz). An exchange that falls outside the model's bound, by more than
+its own half round trip, means the central's clock jumped or another central
+took over, and the estimator starts over from it.
+
+These functions have no ESP-IDF dependencies so they also build on the host
+(see bench/host/sync_host.c).
+*/
+#ifndef SYNC_ESTIMATOR_H
+#define SYNC_ESTIMATOR_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define SYNC_WINDOW_LEN         64       // Exchanges kept for the fit
+/* Exchanges with a longer round trip than SYNC_ROUND_TRIP_EVENTS connection
+ * events plus SYNC_ROUND_TRIP_SLACK_US are rejected: the request and the reply
+ * each wait for an event, and either may be retransmitted at a later one */
+#define SYNC_ROUND_TRIP_EVENTS   4
+#define SYNC_ROUND_TRIP_SLACK_US 100000
+#define SYNC_MAX_EVENT_INTERVAL_US 4000000  // Assumed until the connection is known: the longest BLE allows
+#define SYNC_DELAY_SLACK_US     2000     // Exchanges within 2x the best delay plus this are fitted
+#define SYNC_WANDER_PPM         20       // Allowed frequency change between exchanges
+#define SYNC_NOMINAL_PPM        5000     // Allowed error of the calibrated tick period
+#define SYNC_ERROR_UNKNOWN      UINT32_MAX
+
+/* One round trip */
+struct sync_exchange {
+    int64_t send_us;         // Central clock when the request was sent
+    int64_t return_us;       // Central clock when the reply came back
+    uint32_t receive_ticks;  // Local ticks when the request arrived
+    uint32_t reply_ticks;    // Local ticks when the reply was sent
+};
+
+/* Central time as a function of local ticks */
+struct sync_model {
+    bool valid;
+    uint32_t ref_ticks;      // Local ticks of the newest fitted exchange
+    int64_t ref_us;          // Central time at ref_ticks
+    double us_per_tick;      // Fitted tick period, in central microseconds
+    uint32_t ref_error_us;   // Error bound at ref_ticks
+    double slope_error;      // Relative error bound of us_per_tick, wander included
+};
+
+/* Sync error statistics since the estimator last started over */
+struct sync_stats {
+    uint32_t exchanges;        // Exchanges accepted
+    uint32_t rejected;         // Exchanges that didn't make sense
+    uint32_t last_delay_us;    // Round trip minus local processing, last exchange
+    uint32_t min_delay_us;     // Best delay in the window
+    int32_t last_error_us;     // Central minus predicted time at the last exchange
+    uint32_t max_error_us;     // Largest |last_error_us| so far
+    uint32_t rms_error_us;     // RMS of last_error_us so far
+    uint32_t error_bound_us;   // Model error bound at the last exchange
+    int32_t drift_ppb;         // Fitted tick period against the nominal one
+    uint32_t fitted;           // Exchanges used by the current fit
+};
+
+/* An accepted exchange, as used by the fit */
+struct sync_point {
+    int64_t ticks;      // Local ticks at the midpoint, extended past 32 bits
+    int64_t us;         // Central time at the midpoint
+    uint32_t delay_us;  // Round trip minus local processing
+};
+
+struct sync_estimator {
+    double nominal_us_per_tick;
+    uint32_t max_round_trip_us;
+    struct sync_point window[SYNC_WINDOW_LEN];
+    int count;
+    int next;
+    uint32_t predictions;  // Exchanges checked against an existing model
+    double error_sum_sq;
+    struct sync_model model;
+    struct sync_stats stats;
+};
+
+/* Start over with no exchanges. nominal_us_per_tick is the calibrated period of
+ * the local tick, used until the fit spans some time */
+void sync_estimator_reset(struct sync_estimator *estimator, double nominal_us_per_tick);
+
+/* Set the time between connection events the exchanges travel over, which
+ * bounds their round trip. Keeps the exchanges and the model */
+void sync_estimator_set_interval(struct sync_estimator *estimator, uint32_t event_interval_us);
+
+/* Add an exchange and refit. Returns false if the exchange was rejected */
+bool sync_estimator_add(struct sync_estimator *estimator, const struct sync_exchange *exchange);
+
+/* Central time at local tick count ticks, and a bound on its error. Returns false
+ * (and sets *error_us to SYNC_ERROR_UNKNOWN) if the model isn't valid yet */
+bool sync_model_map(const struct sync_model *model, uint32_t ticks, int64_t *time_us,
+                    uint32_t *error_us);
+
+#endif // SYNC_ESTIMATOR_H
@@ -0,0 +1,185 @@
+/* Implementations for trace.h */
+
+/* Header */
+#include "trace.h"
+
+#if TRACE_MEASURE_COST
+/* Compile ESP_LOGI in for this file so its cost can be measured */
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#endif
+
+/* ESP-IDF headers */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+
+/* Application module headers */
+#include "sched_trace.h"
+
+#define TRACE_LOG_NAME "TRACE"
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0, "TRACE_RING_SIZE must be a power of 2");
+
+/* Single-producer/single-consumer ring owned by one core.
+ * head is only written by the core that owns the ring (with interrupts masked, so
+ * tasks on that core cannot interleave) and tail is only written by the drain task.
+ */
+struct trace_ring {
+    struct trace_record records[TRACE_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t overflows;
+};
+
+static struct trace_ring trace_rings[portNUM_PROCESSORS];
+
+/* Name and console log level used when formatting each event */
+static const struct {
+    const char *name;
+    esp_log_level_t level;
+} trace_event_info[TRACE_EV_COUNT] = {
+    [TRACE_EV_ADC_CHANGED] = {"adc_changed", ESP_LOG_INFO},
+    [TRACE_EV_QUEUE_FULL] = {"queue_full", ESP_LOG_ERROR},
+    [TRACE_EV_VALUE_CONSUMED] = {"value_consumed", ESP_LOG_INFO},
+    [TRACE_EV_NOTIFY_SENT] = {"notify_sent", ESP_LOG_INFO},
+    [TRACE_EV_NOTIFY_DROPPED] = {"notify_dropped", ESP_LOG_WARN},
+    [TRACE_EV_NOTIFY_BACKOFF] = {"notify_backoff", ESP_LOG_INFO},
+    [TRACE_EV_ULP_PERIOD] = {"ulp_period", ESP_LOG_INFO},
+    [TRACE_EV_STACK_RESET] = {"stack_reset", ESP_LOG_WARN},
+    [TRACE_EV_STACK_SYNCED] = {"stack_synced", ESP_LOG_INFO},
+    [TRACE_EV_STACK_RECOVERED] = {"stack_recovered", ESP_LOG_WARN},
+};
+
+
+void trace_event(enum trace_event event, uint32_t arg0, uint32_t arg1)
+{
+    /* Masking interrupts keeps the core ID valid and makes this core the only writer of its ring */
+    UBaseType_t irq_state = portSET_INTERRUPT_MASK_FROM_ISR();
+    struct trace_ring *ring = &trace_rings[xPortGetCoreID()];
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= TRACE_RING_SIZE) {
+        ring->overflows++;
+    } else {
+        struct trace_record *record = &ring->records[head & TRACE_RING_MASK];
+        record->timestamp_us = (uint32_t)esp_timer_get_time();
+        record->event = (uint16_t)event;
+        record->core = (uint16_t)xPortGetCoreID();
+        record->arg0 = arg0;
+        record->arg1 = arg1;
+        /* Publish the record only after it has been fully written */
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq_state);
+
+#if SCHED_TRACE_ENABLED
+    /* Show pipeline events alongside the scheduler activity */
+    sched_trace_pipeline((uint16_t)event, arg0);
+#endif
+}
+
+
+const char *trace_event_name(enum trace_event event)
+{
+    return (event < TRACE_EV_COUNT) ? trace_event_info[event].name : "unknown";
+}
+
+
+uint32_t trace_overflow_count(void)
+{
+    uint32_t total = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        total += __atomic_load_n(&trace_rings[core].overflows, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+
+/* Format every record currently in a ring and release the slots */
+static void drain_ring(struct trace_ring *ring)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+        const struct trace_record *record = &ring->records[tail & TRACE_RING_MASK];
+        if (record->event < TRACE_EV_COUNT) {
+            ESP_LOG_LEVEL_LOCAL(trace_event_info[record->event].level, TRACE_LOG_NAME,
+                "%10"PRIu32"us core%"PRIu16" %s %"PRIu32" %"PRIu32, record->timestamp_us, record->core,
+                trace_event_info[record->event].name, record->arg0, record->arg1);
+        }
+        tail++;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+
+/* Low priority task that formats recorded events */
+static void trace_drain_task(void *pvParameters)
+{
+    uint32_t reported_overflows = 0;
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_PERIOD_MS));
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            drain_ring(&trace_rings[core]);
+        }
+        uint32_t overflows = trace_overflow_count();
+        if (overflows != reported_overflows) {
+            ESP_LOGW(TRACE_LOG_NAME, "%"PRIu32" trace events dropped so far (ring full)", overflows);
+            reported_overflows = overflows;
+        }
+    }
+}
+
+
+#if TRACE_MEASURE_COST
+#define TRACE_COST_ITERATIONS 16
+#define TRACE_COST_LOG_NAME "TRACE_COST"
+
+/* Compare the per-call cost of recording an event with formatting it through ESP_LOGI */
+static void measure_trace_cost(void)
+{
+    uint32_t start;
+    uint32_t trace_cycles;
+    uint32_t log_cycles;
+
+    esp_log_level_set(TRACE_COST_LOG_NAME, ESP_LOG_INFO);
+
+    start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < TRACE_COST_ITERATIONS; i++) {
+        trace_event(TRACE_EV_VALUE_CONSUMED, i, 0);
+    }
+    trace_cycles = (esp_cpu_get_cycle_count() - start) / TRACE_COST_ITERATIONS;
+
+    start = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < TRACE_COST_ITERATIONS; i++) {
+        ESP_LOGI(TRACE_COST_LOG_NAME, "New potentiometer value sent to BLE: %"PRIu32"\n", i);
+    }
+    log_cycles = (esp_cpu_get_cycle_count() - start) / TRACE_COST_ITERATIONS;
+
+    ESP_LOGW(TRACE_LOG_NAME, "per-call cost: trace_event %"PRIu32" cycles, ESP_LOGI %"PRIu32" cycles",
+        trace_cycles, log_cycles);
+}
+#endif
+
+
+void trace_init(void)
+{
+#if TRACE_MEASURE_COST
+    measure_trace_cost();
+#endif
+
+    xTaskCreatePinnedToCore(
+        trace_drain_task,
+        "Trace Drain",
+        2048,
+        NULL,
+        TRACE_DRAIN_PRIORITY,
+        NULL,
+        TRACE_DRAIN_CORE
+    );
+}
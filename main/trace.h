@@ -0,0 +1,56 @@
+/* Lightweight deferred binary logging for hot paths
+
+Call sites on the sampling and notification paths record fixed-size binary
+events instead of formatting strings with ESP_LOGx. Each core writes into its
+own ring buffer, so recording never takes a lock or blocks; when a ring is full
+the event is dropped and counted. A low priority task drains the rings and
+formats the records on the console, off the hot path.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+
+#define TRACE_RING_SIZE       64   // Records per core, must be a power of 2
+#define TRACE_DRAIN_PERIOD_MS 250  // How often the drain task empties the rings
+#define TRACE_DRAIN_CORE      0
+#define TRACE_DRAIN_PRIORITY  1    // Lower than every pipeline task
+#define TRACE_MEASURE_COST    0    // Set to 1 to log the cost of trace_event vs ESP_LOGI at startup
+
+/* Events recorded by the application. Keep in sync with the names in trace.c */
+enum trace_event {
+    TRACE_EV_ADC_CHANGED,     // arg0: new ADC value, arg1: previous ADC value
+    TRACE_EV_QUEUE_FULL,      // arg0: ADC value that could not be queued
+    TRACE_EV_VALUE_CONSUMED,  // arg0: value published to BLE, arg1: quality flags
+    TRACE_EV_NOTIFY_SENT,     // arg0: connection handle, arg1: attribute handle
+    TRACE_EV_NOTIFY_DROPPED,  // arg0: connection handle, arg1: NimBLE error code
+    TRACE_EV_NOTIFY_BACKOFF,  // arg0: connection handle, arg1: new notify period in ms
+    TRACE_EV_ULP_PERIOD,      // arg0: ULP wake period index, arg1: wake period in us
+    TRACE_EV_STACK_RESET,     // arg0: NimBLE reset reason
+    TRACE_EV_STACK_SYNCED,    // arg0: ms since the reset
+    TRACE_EV_STACK_RECOVERED, // arg0: ms from the reset to the first notification, arg1: resets so far
+    TRACE_EV_COUNT
+};
+
+/* Fixed-size binary record stored in the per-core rings */
+struct trace_record {
+    uint32_t timestamp_us;  // Low 32 bits of esp_timer_get_time()
+    uint16_t event;         // enum trace_event
+    uint16_t core;          // Core that recorded the event
+    uint32_t arg0;
+    uint32_t arg1;
+};
+
+/* Record an event. Safe to call from any task on either core; never blocks */
+void trace_event(enum trace_event event, uint32_t arg0, uint32_t arg1);
+
+/* Name of an event, as printed by the drain task */
+const char *trace_event_name(enum trace_event event);
+
+/* Number of events dropped because a ring was full */
+uint32_t trace_overflow_count(void);
+
+/* Start the task that drains and formats recorded events */
+void trace_init(void);
+
+#endif // TRACE_H
@@ -7,3 +7,11 @@
 #define ULP_ADC_UNIT            0  // ADC_UNIT_1
 #define ULP_ADC_ATTEN           3  // ADC_ATTEN_DB_12
 #define ULP_ADC_BITWIDTH        0  // ADC_BITWIDTH_DEFAULT
+
+/* Activity-adaptive wake period. The ULP selects one of the SENS_ULP_CP_SLEEP_CYCx
+ * registers (index 0 fastest) for its next wake up; the periods themselves are
+ * programmed by the main CPU from the runtime configuration (ulp_period_ms in
+ * app_config.h, defaulting to ULP_WAKEUP_PERIODS_MS in producer.h) */
+#define ULP_WAKE_PERIOD_COUNT   5  // SENS_ULP_CP_SLEEP_CYC0..4
+#define ULP_ACTIVITY_THRESHOLD  4  // ADC change between wake ups that counts as movement
+#define ULP_STABLE_SAMPLES      10  // Stable readings before slowing down one step